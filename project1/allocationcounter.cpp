@@ -0,0 +1,61 @@
+
+#include "allocationcounter.hpp"
+#include <boost/atomic.hpp>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+    boost::atomic<std::size_t> allocations(0);
+
+    void* countedAllocation(std::size_t size) {
+        ++allocations;
+        void* p = std::malloc(size > 0 ? size : 1);
+        if (!p)
+            throw std::bad_alloc();
+        return p;
+    }
+
+}
+
+namespace QuantLib {
+
+    Size AllocationCounter::total() {
+        return allocations.load();
+    }
+
+}
+
+void* operator new(std::size_t size) {
+    return countedAllocation(size);
+}
+
+void* operator new[](std::size_t size) {
+    return countedAllocation(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) throw() {
+    ++allocations;
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) throw() {
+    ++allocations;
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void operator delete(void* p) throw() {
+    std::free(p);
+}
+
+void operator delete[](void* p) throw() {
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) throw() {
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) throw() {
+    std::free(p);
+}
@@ -0,0 +1,37 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file allocationcounter.hpp
+    \brief Counter of heap allocations
+*/
+
+#ifndef allocation_counter_hpp
+#define allocation_counter_hpp
+
+#include <ql/types.hpp>
+
+namespace QuantLib {
+
+    //! Counts the heap allocations made through operator new
+    /*! The count is maintained by the replacement of the global
+        operator new in allocationcounter.cpp, which must be linked
+        into the program; it is meant for benchmarks and checks, not
+        for production builds.
+
+        A counter reports the allocations made, by any thread, since
+        its construction.
+    */
+    class AllocationCounter {
+      public:
+        AllocationCounter() : start_(total()) {}
+        //! allocations since the counter was built
+        Size allocations() const { return total() - start_; }
+        //! allocations since the start of the program
+        static Size total();
+      private:
+        Size start_;
+    };
+
+}
+
+
+#endif
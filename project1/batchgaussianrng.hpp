@@ -0,0 +1,266 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file batchgaussianrng.hpp
+    \brief Batched Box-Muller Gaussian sequence generator
+*/
+
+#ifndef batch_gaussian_rng_hpp
+#define batch_gaussian_rng_hpp
+
+#include "counterbasedrng.hpp"
+#include <ql/math/constants.hpp>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace QuantLib {
+
+    //! Box-Muller transform of a contiguous buffer
+    /*! Turns n uniform deviates into n standard Gaussian deviates;
+        n must be even. The first half of the buffer gives the radii
+        and the second half the angles, so that both are read
+        sequentially.
+
+        When compiled with AVX2 support, four deviates are processed
+        at a time with polynomial approximations of the logarithm
+        and of the sine and cosine (after Cephes) which are accurate
+        to a few ulps; otherwise, the same algorithm runs on scalars
+        with the standard library functions.
+    */
+    void boxMullerTransform(const Real* uniforms, Real* normals, Size n);
+
+
+    //! Gaussian random-sequence generator working in batches
+    /*! Gaussian deviates are produced a batch at a time from Philox
+        uniform deviates, and sequences are served from the batch.
+        Like PhiloxUniformRsg, the generator can start at any
+        sequence of its stream.
+
+        \ingroup mcarlo
+    */
+    class BoxMullerBatchRsg {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        /*! each batch contains at least the given number of deviates
+            and a whole number of sequences.
+        */
+        BoxMullerBatchRsg(Size dimensionality,
+                          BigNatural seed = 0,
+                          BigNatural firstSequence = 0,
+                          Size batchSize = 1024);
+        const sample_type& nextSequence() const;
+        const sample_type& lastSequence() const { return sequence_; }
+        Size dimension() const { return dimensionality_; }
+      private:
+        Size dimensionality_, sequencesPerBatch_;
+        mutable PhiloxUniformRsg uniforms_;
+        mutable std::vector<Real> batch_;
+        mutable BigNatural next_, currentBatch_;
+        mutable sample_type sequence_;
+    };
+
+
+    //! random-number policy drawing Gaussian deviates in batches
+    struct BatchGaussianRandom {
+        // typedefs
+        typedef BoxMullerBatchRsg rsg_type;
+        // more traits
+        enum { allowsErrorEstimate = 1 };
+        // factory
+        static rsg_type make_sequence_generator(Size dimension,
+                                                BigNatural seed,
+                                                BigNatural firstSequence = 0) {
+            return rsg_type(dimension, seed, firstSequence);
+        }
+    };
+
+    template <>
+    struct RandomAccessTraits<BatchGaussianRandom> {
+        enum { allowsRandomAccess = 1 };
+        static BatchGaussianRandom::rsg_type
+        make_sequence_generator(Size dimension, BigNatural seed,
+                                BigNatural firstSequence) {
+            return BatchGaussianRandom::make_sequence_generator(
+                                              dimension, seed, firstSequence);
+        }
+    };
+
+
+    // inline definitions
+
+    namespace detail {
+
+        // Cephes coefficients for log(1+x) on [sqrt(1/2)-1, sqrt(2)-1]
+        const Real boxMullerLogP[] = {
+            1.01875663804580931796E-4, 4.97494994976747001425E-1,
+            4.70579119878881725854E0,  1.44989225341610930846E1,
+            1.79368678507819816313E1,  7.70838733755885391666E0 };
+        const Real boxMullerLogQ[] = {
+            1.12873587189167450590E1,  4.52279145837532221105E1,
+            8.29875266912776603211E1,  7.11544750618563894466E1,
+            2.31251620126765340583E1 };
+        // Cephes coefficients for sin and cos on [-pi/4, pi/4]
+        const Real boxMullerSin[] = {
+            1.58962301576546568060E-10, -2.50507477628578072866E-8,
+            2.75573136213857245213E-6,  -1.98412698295895385996E-4,
+            8.33333333332211858878E-3,  -1.66666666666666307295E-1 };
+        const Real boxMullerCos[] = {
+            -1.13585365213876817300E-11, 2.08757008419747316778E-9,
+            -2.75573141792967388112E-7,  2.48015872888517045348E-5,
+            -1.38888888888730564116E-3,  4.16666666666665929218E-2 };
+
+        /* The angle 2 pi u is written as q pi/2 + phi, with q the
+           nearest quadrant and |phi| <= pi/4; cos and sin of the
+           angle are then obtained from those of phi by swapping
+           and changing sign according to q. */
+        inline void boxMullerScalar(Real u1, Real u2, Real& z1, Real& z2) {
+            Real r = std::sqrt(-2.0*std::log(u1));
+            Real v = 4.0*u2;
+            Real q = std::floor(v + 0.5);
+            Real phi = (v - q)*M_PI_2;
+            Real s = std::sin(phi), c = std::cos(phi);
+            int quadrant = int(q) & 3;
+            Real cosine = (quadrant & 1) ? s : c;
+            Real sine = (quadrant & 1) ? c : s;
+            if (quadrant == 1 || quadrant == 2)
+                cosine = -cosine;
+            if (quadrant >= 2)
+                sine = -sine;
+            z1 = r*cosine;
+            z2 = r*sine;
+        }
+
+        #if defined(__AVX2__)
+
+        inline __m256d polynomial256(__m256d x, const Real* c, Size n) {
+            __m256d y = _mm256_set1_pd(c[0]);
+            for (Size i=1; i<n; ++i)
+                y = _mm256_add_pd(_mm256_mul_pd(y, x), _mm256_set1_pd(c[i]));
+            return y;
+        }
+
+        inline __m256d log256(__m256d x) {
+            const __m256d one = _mm256_set1_pd(1.0);
+            const __m256d two52 = _mm256_set1_pd(4503599627370496.0);
+            __m256i bits = _mm256_castpd_si256(x);
+            // biased exponent, converted to double through 2^52
+            __m256i biased = _mm256_srli_epi64(bits, 52);
+            __m256d e = _mm256_sub_pd(
+                _mm256_castsi256_pd(_mm256_or_si256(
+                                     biased, _mm256_castpd_si256(two52))),
+                _mm256_set1_pd(4503599627370496.0 + 1022.0));
+            // mantissa in [1/2, 1)
+            __m256d m = _mm256_castsi256_pd(_mm256_or_si256(
+                _mm256_and_si256(bits,
+                                 _mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL)),
+                _mm256_set1_epi64x(0x3FE0000000000000LL)));
+            __m256d small = _mm256_cmp_pd(
+                m, _mm256_set1_pd(0.70710678118654752440), _CMP_LT_OQ);
+            e = _mm256_sub_pd(e, _mm256_and_pd(small, one));
+            __m256d y = _mm256_add_pd(_mm256_sub_pd(m, one),
+                                      _mm256_and_pd(small, m));
+            __m256d z = _mm256_mul_pd(y, y);
+            // Q has a unit leading coefficient
+            __m256d q = _mm256_add_pd(
+                _mm256_mul_pd(_mm256_add_pd(y, _mm256_set1_pd(
+                                                 boxMullerLogQ[0])), y),
+                _mm256_set1_pd(boxMullerLogQ[1]));
+            for (Size i=2; i<5; ++i)
+                q = _mm256_add_pd(_mm256_mul_pd(q, y),
+                                  _mm256_set1_pd(boxMullerLogQ[i]));
+            __m256d r = _mm256_mul_pd(y, _mm256_div_pd(
+                _mm256_mul_pd(z, polynomial256(y, boxMullerLogP, 6)), q));
+            r = _mm256_sub_pd(r, _mm256_mul_pd(
+                    e, _mm256_set1_pd(2.121944400546905827679e-4)));
+            r = _mm256_sub_pd(r, _mm256_mul_pd(z, _mm256_set1_pd(0.5)));
+            r = _mm256_add_pd(y, r);
+            return _mm256_add_pd(r, _mm256_mul_pd(
+                                    e, _mm256_set1_pd(0.693359375)));
+        }
+
+        inline void boxMuller256(const Real* u1, const Real* u2,
+                                 Real* z1, Real* z2) {
+            const __m256d signBit = _mm256_set1_pd(-0.0);
+            __m256d r = _mm256_sqrt_pd(_mm256_mul_pd(
+                  _mm256_set1_pd(-2.0), log256(_mm256_loadu_pd(u1))));
+            __m256d v = _mm256_mul_pd(_mm256_set1_pd(4.0),
+                                      _mm256_loadu_pd(u2));
+            __m256d q = _mm256_round_pd(
+                       v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            __m256d phi = _mm256_mul_pd(_mm256_sub_pd(v, q),
+                                        _mm256_set1_pd(M_PI_2));
+            __m256d phi2 = _mm256_mul_pd(phi, phi);
+            __m256d s = _mm256_add_pd(phi, _mm256_mul_pd(phi,
+                _mm256_mul_pd(phi2, polynomial256(phi2, boxMullerSin, 6))));
+            __m256d c = _mm256_add_pd(
+                _mm256_sub_pd(_mm256_set1_pd(1.0),
+                              _mm256_mul_pd(phi2, _mm256_set1_pd(0.5))),
+                _mm256_mul_pd(_mm256_mul_pd(phi2, phi2),
+                              polynomial256(phi2, boxMullerCos, 6)));
+            __m256d q1 = _mm256_cmp_pd(q, _mm256_set1_pd(1.0), _CMP_EQ_OQ);
+            __m256d q2 = _mm256_cmp_pd(q, _mm256_set1_pd(2.0), _CMP_EQ_OQ);
+            __m256d q3 = _mm256_cmp_pd(q, _mm256_set1_pd(3.0), _CMP_EQ_OQ);
+            __m256d swap = _mm256_or_pd(q1, q3);
+            __m256d cosine = _mm256_blendv_pd(c, s, swap);
+            __m256d sine = _mm256_blendv_pd(s, c, swap);
+            cosine = _mm256_xor_pd(cosine,
+                         _mm256_and_pd(_mm256_or_pd(q1, q2), signBit));
+            sine = _mm256_xor_pd(sine,
+                         _mm256_and_pd(_mm256_or_pd(q2, q3), signBit));
+            _mm256_storeu_pd(z1, _mm256_mul_pd(r, cosine));
+            _mm256_storeu_pd(z2, _mm256_mul_pd(r, sine));
+        }
+
+        #endif
+
+    }
+
+    inline void boxMullerTransform(const Real* uniforms, Real* normals,
+                                   Size n) {
+        QL_REQUIRE(n % 2 == 0, "even number of deviates required");
+        Size half = n/2, i = 0;
+        #if defined(__AVX2__)
+        for (; i+4<=half; i+=4)
+            detail::boxMuller256(uniforms+i, uniforms+half+i,
+                                 normals+i, normals+half+i);
+        #endif
+        for (; i<half; ++i)
+            detail::boxMullerScalar(uniforms[i], uniforms[half+i],
+                                    normals[i], normals[half+i]);
+    }
+
+
+    inline BoxMullerBatchRsg::BoxMullerBatchRsg(Size dimensionality,
+                                                BigNatural seed,
+                                                BigNatural firstSequence,
+                                                Size batchSize)
+    : dimensionality_(dimensionality),
+      sequencesPerBatch_(std::max<Size>(batchSize/dimensionality, 1)),
+      uniforms_(sequencesPerBatch_*dimensionality
+                + (sequencesPerBatch_*dimensionality) % 2, seed),
+      batch_(uniforms_.dimension()),
+      next_(firstSequence), currentBatch_(Null<BigNatural>()),
+      sequence_(std::vector<Real>(dimensionality), 1.0) {}
+
+    inline const BoxMullerBatchRsg::sample_type&
+    BoxMullerBatchRsg::nextSequence() const {
+        BigNatural b = next_ / sequencesPerBatch_;
+        Size offset = (next_ % sequencesPerBatch_) * dimensionality_;
+        if (b != currentBatch_) {
+            // the b-th uniform sequence feeds the b-th batch
+            uniforms_.skipTo(b);
+            const std::vector<Real>& u = uniforms_.nextSequence().value;
+            boxMullerTransform(&u[0], &batch_[0], batch_.size());
+            currentBatch_ = b;
+        }
+        std::copy(batch_.begin() + offset,
+                  batch_.begin() + offset + dimensionality_,
+                  sequence_.value.begin());
+        ++next_;
+        return sequence_;
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,301 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file blockpathgenerator.hpp
+    \brief Generates blocks of paths in structure-of-arrays layout
+*/
+
+#ifndef block_path_generator_hpp
+#define block_path_generator_hpp
+
+#include "constantblackscholesprocess.hpp"
+#include "montecarloarena.hpp"
+#include <ql/methods/montecarlo/brownianbridge.hpp>
+#include <ql/math/distributions/normaldistribution.hpp>
+#include <ql/timegrid.hpp>
+
+namespace QuantLib {
+
+    //! sampling schemes for the terminal variate of a block of paths
+    /*! The standardized Brownian motion at maturity of consecutive
+        groups of paths can be drawn by stratified sampling, one path
+        per equal-probability stratum, or be shifted and rescaled so
+        that its sample mean and variance in the group are 0 and 1
+        (moment matching). The components of the paths orthogonal to
+        it are left untouched.
+
+        The paths of a group are not independent; their mean should
+        be used as a single sample.
+    */
+    struct BlockSampling {
+        enum Type { Independent, Stratified, MomentMatching };
+    };
+
+    //! Generates blocks of constant-coefficient Black-Scholes paths
+    /*! Instead of one Path object per sample, a whole block of paths
+        is stored in one buffer with a contiguous array for each time
+        of the grid; the evolution of the block over a time step is a
+        single loop over that array, which the compiler can
+        vectorize.
+
+        The i-th path of a block uses the i-th sequence drawn from
+        the generator, exactly as PathGenerator would, so that both
+        produce the same paths.
+
+        Buffers are carved from the given arena, if any, and must not
+        be used after the latter is reset; otherwise, the generator
+        owns them. Generating paths does not allocate memory.
+
+        \ingroup mcarlo
+    */
+    template <class GSG>
+    class BlockPathGenerator : private boost::noncopyable {
+      public:
+        typedef GSG generator_type;
+        BlockPathGenerator(
+                const boost::shared_ptr<ConstantBlackScholesProcess>& process,
+                const TimeGrid& timeGrid,
+                const GSG& generator,
+                bool brownianBridge,
+                Size blockSize,
+                MonteCarloArena* arena = 0);
+        //! simulates a new block of paths
+        /*! At most blockSize paths can be required. If antithetic
+            paths are required, they are stored right after the
+            original ones, i.e., the antithetic of the j-th path is
+            the (paths+j)-th one.
+        */
+        void next(Size paths, bool antithetic = false) const;
+        //! shifts the mean of the terminal Gaussian variate
+        /*! The standardized Brownian motion at maturity, which is
+            N(0,1) under the original measure, is drawn from
+            N(shift,1) instead; each step gets its share of the shift
+            in proportion to its variance. The likelihood ratios of
+            the paths must then be used to weight the samples.
+        */
+        void setTerminalShift(Real shift);
+        //! sets the sampling scheme of the terminal variate
+        /*! Groups are formed by consecutive paths of each block and
+            can't be larger than the latter; the last group of a block
+            can be smaller than the others, and is left as drawn by
+            moment matching if it has a single path. If
+            antithetic paths are required, they are the mirror images
+            of the sampled ones and form groups of their own.
+        */
+        void setSampling(BlockSampling::Type sampling, Size groupSize);
+        BlockSampling::Type sampling() const { return sampling_; }
+        Size groupSize() const { return groupSize_; }
+        Real terminalShift() const { return shift_; }
+        //! likelihood ratios of n terminal values with respect to the
+        //! original measure
+        void likelihoodRatios(const Real* terminal, Real* ratios,
+                              Size n) const;
+        //! values of the block paths at the i-th time of the grid
+        const Real* values(Size i) const {
+            return values_ + i*capacity_;
+        }
+        Size blockSize() const { return blockSize_; }
+        Real x0() const { return x0_; }
+        const TimeGrid& timeGrid() const { return timeGrid_; }
+      private:
+        void sampleTerminalVariates(Size paths) const;
+        GSG generator_;
+        TimeGrid timeGrid_;
+        Real x0_;
+        Size steps_, blockSize_, capacity_;
+        Real shift_, terminalDrift_, terminalStdDev_;
+        BlockSampling::Type sampling_;
+        Size groupSize_;
+        CumulativeNormalDistribution cumulative_;
+        InverseCumulativeNormal inverseCumulative_;
+        bool brownianBridge_;
+        BrownianBridge bridge_;
+        MonteCarloArena ownArena_;
+        Real *drift_, *stdDev_;
+        Real *normals_, *values_, *temp_, *terminal_;
+    };
+
+
+    // template definitions
+
+    template <class GSG>
+    BlockPathGenerator<GSG>::BlockPathGenerator(
+                const boost::shared_ptr<ConstantBlackScholesProcess>& process,
+                const TimeGrid& timeGrid,
+                const GSG& generator,
+                bool brownianBridge,
+                Size blockSize,
+                MonteCarloArena* arena)
+    : generator_(generator), timeGrid_(timeGrid), x0_(process->x0()),
+      steps_(timeGrid.size()-1), blockSize_(blockSize),
+      capacity_(2*blockSize),
+      shift_(0.0), terminalDrift_(0.0), terminalStdDev_(0.0),
+      sampling_(BlockSampling::Independent), groupSize_(1),
+      brownianBridge_(brownianBridge), bridge_(timeGrid) {
+        QL_REQUIRE(blockSize > 0, "null block size given");
+        QL_REQUIRE(generator_.dimension() == steps_,
+                   "sequence generator dimensionality ("
+                   << generator_.dimension()
+                   << ") != timeSteps (" << steps_ << ")");
+        if (!arena)
+            arena = &ownArena_;
+        drift_ = arena->allocate(steps_);
+        stdDev_ = arena->allocate(steps_);
+        normals_ = arena->allocate(steps_*capacity_);
+        values_ = arena->allocate((steps_+1)*capacity_);
+        temp_ = arena->allocate(steps_);
+        terminal_ = arena->allocate(blockSize_);
+        // the process is constant: one call per step is enough
+        Real variance = 0.0;
+        for (Size i=0; i<steps_; ++i) {
+            Time t = timeGrid_[i], dt = timeGrid_.dt(i);
+            drift_[i] = process->drift(t, x0_) * dt;
+            stdDev_[i] = process->stdDeviation(t, x0_, dt);
+            terminalDrift_ += drift_[i];
+            variance += stdDev_[i]*stdDev_[i];
+        }
+        terminalStdDev_ = std::sqrt(variance);
+        std::fill(values_, values_+capacity_, x0_);
+    }
+
+    template <class GSG>
+    void BlockPathGenerator<GSG>::next(Size paths, bool antithetic) const {
+        QL_REQUIRE(paths <= blockSize_,
+                   "block size (" << blockSize_ << ") exceeded");
+
+        // scatter the sequences into one array per step
+        for (Size j=0; j<paths; ++j) {
+            const std::vector<Real>& sequence =
+                generator_.nextSequence().value;
+            const Real* z = &sequence[0];
+            if (brownianBridge_) {
+                bridge_.transform(sequence.begin(), sequence.end(), temp_);
+                z = temp_;
+            }
+            for (Size i=0; i<steps_; ++i)
+                normals_[i*capacity_+j] = z[i];
+        }
+        if (sampling_ != BlockSampling::Independent)
+            sampleTerminalVariates(paths);
+        if (antithetic) {
+            for (Size i=0; i<steps_; ++i) {
+                Real* z = normals_ + i*capacity_;
+                for (Size j=0; j<paths; ++j)
+                    z[paths+j] = -z[j];
+            }
+        }
+
+        Size n = antithetic ? 2*paths : paths;
+        for (Size i=0; i<steps_; ++i) {
+            const Real* z = normals_ + i*capacity_;
+            const Real* from = values_ + i*capacity_;
+            Real* to = values_ + (i+1)*capacity_;
+            const Real mu = drift_[i], sigma = stdDev_[i];
+            for (Size j=0; j<n; ++j)
+                to[j] = from[j] * std::exp(mu + sigma*z[j]);
+        }
+    }
+
+    template <class GSG>
+    void BlockPathGenerator<GSG>::setTerminalShift(Real shift) {
+        QL_REQUIRE(terminalStdDev_ > 0.0,
+                   "a shift requires a positive terminal variance");
+        // z_i + a_i with a_i = shift * stdDev_i/terminalStdDev; this
+        // is folded into the drift of the step
+        for (Size i=0; i<steps_; ++i)
+            drift_[i] += (shift - shift_) * stdDev_[i]*stdDev_[i]
+                                          / terminalStdDev_;
+        shift_ = shift;
+    }
+
+    template <class GSG>
+    void BlockPathGenerator<GSG>::setSampling(BlockSampling::Type sampling,
+                                              Size groupSize) {
+        QL_REQUIRE(groupSize > 0, "null group size given");
+        QL_REQUIRE(sampling != BlockSampling::MomentMatching ||
+                   groupSize > 1,
+                   "moment matching requires at least two paths per group");
+        QL_REQUIRE(sampling == BlockSampling::Independent ||
+                   groupSize <= blockSize_,
+                   "group size (" << groupSize << ") larger than block size ("
+                   << blockSize_ << ")");
+        QL_REQUIRE(sampling == BlockSampling::Independent ||
+                   terminalStdDev_ > 0.0,
+                   "terminal sampling requires a positive terminal variance");
+        sampling_ = sampling;
+        groupSize_ = (sampling == BlockSampling::Independent ? 1
+                                                             : groupSize);
+    }
+
+    template <class GSG>
+    void BlockPathGenerator<GSG>::sampleTerminalVariates(Size paths) const {
+        /* The standardized terminal variate is w = sum a_i z_i with
+           a_i = stdDev_i/terminalStdDev; changing it to w' is done by
+           adding (w'-w) a_i to each z_i, which leaves the orthogonal
+           components, independent of w, as they are. */
+        Real* w = terminal_;
+        std::fill(w, w+paths, 0.0);
+        for (Size i=0; i<steps_; ++i) {
+            const Real* z = normals_ + i*capacity_;
+            const Real a = stdDev_[i]/terminalStdDev_;
+            for (Size j=0; j<paths; ++j)
+                w[j] += a*z[j];
+        }
+
+        // w[j] is replaced by the required change w'-w
+        for (Size first=0; first<paths; first+=groupSize_) {
+            Size n = std::min(groupSize_, paths-first);
+            Real* g = w + first;
+            if (sampling_ == BlockSampling::Stratified) {
+                // the j-th path goes in the j-th stratum; its position
+                // there is given by the uniform variate N(w)
+                for (Size j=0; j<n; ++j) {
+                    Real u = std::min(std::max(cumulative_(g[j]),
+                                               QL_EPSILON),
+                                      1.0-QL_EPSILON);
+                    g[j] = inverseCumulative_((j+u)/n) - g[j];
+                }
+            } else {
+                Real mean = 0.0, variance = 0.0;
+                for (Size j=0; j<n; ++j)
+                    mean += g[j];
+                mean /= n;
+                for (Size j=0; j<n; ++j)
+                    variance += (g[j]-mean)*(g[j]-mean);
+                if (variance > 0.0) {
+                    Real scale = std::sqrt(n/variance);
+                    for (Size j=0; j<n; ++j)
+                        g[j] = (g[j]-mean)*scale - g[j];
+                } else {
+                    // a single path, or equal ones, can't be rescaled
+                    std::fill(g, g+n, 0.0);
+                }
+            }
+        }
+
+        for (Size i=0; i<steps_; ++i) {
+            Real* z = normals_ + i*capacity_;
+            const Real a = stdDev_[i]/terminalStdDev_;
+            for (Size j=0; j<paths; ++j)
+                z[j] += a*w[j];
+        }
+    }
+
+    template <class GSG>
+    void BlockPathGenerator<GSG>::likelihoodRatios(const Real* terminal,
+                                                   Real* ratios,
+                                                   Size n) const {
+        /* The ratio exp(-sum a_i z_i + sum a_i^2 / 2) only depends on
+           the terminal value, since sum a_i z_i is the shift times
+           the standardized Brownian motion at maturity. */
+        const Real shift = shift_, halfShift2 = 0.5*shift_*shift_;
+        for (Size j=0; j<n; ++j) {
+            Real w = (std::log(terminal[j]/x0_) - terminalDrift_)
+                   / terminalStdDev_;
+            ratios[j] = std::exp(halfShift2 - shift*w);
+        }
+    }
+
+}
+
+
+#endif
@@ -1,3 +1,75 @@
 
 #include "constantblackscholesprocess.hpp"
 
+namespace QuantLib {
+
+    ConstantBlackScholesProcess::ConstantBlackScholesProcess(
+                                                Real x0,
+                                                Rate riskFreeRate,
+                                                Rate dividendYield,
+                                                Volatility volatility)
+    : x0_(x0), r_(riskFreeRate), q_(dividendYield), sigma_(volatility),
+      logDrift_(riskFreeRate - dividendYield - 0.5*volatility*volatility) {
+        QL_REQUIRE(x0 > 0.0, "negative or null underlying given");
+        QL_REQUIRE(volatility >= 0.0, "negative volatility given");
+    }
+
+    Real ConstantBlackScholesProcess::x0() const {
+        return x0_;
+    }
+
+    Real ConstantBlackScholesProcess::drift(Time, Real) const {
+        return logDrift_;
+    }
+
+    Real ConstantBlackScholesProcess::diffusion(Time, Real) const {
+        return sigma_;
+    }
+
+    Real ConstantBlackScholesProcess::expectation(Time, Real x0,
+                                                  Time dt) const {
+        return x0 * std::exp((r_ - q_)*dt);
+    }
+
+    Real ConstantBlackScholesProcess::stdDeviation(Time, Real,
+                                                   Time dt) const {
+        return sigma_ * std::sqrt(dt);
+    }
+
+    Real ConstantBlackScholesProcess::variance(Time, Real, Time dt) const {
+        return sigma_ * sigma_ * dt;
+    }
+
+    Real ConstantBlackScholesProcess::evolve(Time, Real x0,
+                                             Time dt, Real dw) const {
+        // exact solution, no discretization error
+        return x0 * std::exp(logDrift_*dt + sigma_*std::sqrt(dt)*dw);
+    }
+
+    Real ConstantBlackScholesProcess::apply(Real x0, Real dx) const {
+        return x0 * std::exp(dx);
+    }
+
+
+    boost::shared_ptr<ConstantBlackScholesProcess>
+    makeConstantBlackScholesProcess(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Time maturity,
+             Real strike) {
+        QL_REQUIRE(process, "null Black-Scholes process");
+        QL_REQUIRE(maturity > 0.0,
+                   "positive maturity required, " << maturity << " given");
+
+        Real s0 = process->x0();
+        Rate r = process->riskFreeRate()->zeroRate(maturity, Continuous,
+                                                   NoFrequency, true);
+        Rate q = process->dividendYield()->zeroRate(maturity, Continuous,
+                                                    NoFrequency, true);
+        Volatility sigma = process->blackVolatility()->blackVol(
+                          maturity, strike == Null<Real>() ? s0 : strike, true);
+
+        return boost::shared_ptr<ConstantBlackScholesProcess>(
+                           new ConstantBlackScholesProcess(s0, r, q, sigma));
+    }
+
+}
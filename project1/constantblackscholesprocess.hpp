@@ -1,13 +1,79 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file constantblackscholesprocess.hpp
+    \brief Black-Scholes process with constant coefficients
+*/
+
+#ifndef constant_black_scholes_process_hpp
+#define constant_black_scholes_process_hpp
 
 #include <ql/stochasticprocess.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
 
 namespace QuantLib {
 
-    class ConstantBlackScholesProcess : public StochasticProcess1D {
+    //! Black-Scholes process with constant rates and volatility
+    /*! This class describes the stochastic process \f$ S \f$ governed by
+        \f[
+            dS(t, S) = (r - q) S dt + \sigma S dW_t
+        \f]
+        where \f$ r \f$, \f$ q \f$ and \f$ \sigma \f$ are constant.
+        They are stored once at construction, so that none of the
+        methods below needs to query a term structure.
+
+        As in GeneralizedBlackScholesProcess, drift, diffusion,
+        standard deviation and variance refer to the logarithm of the
+        underlying, while x0 and evolve return the underlying itself.
 
-        // your implementation goes here
-        
+        \ingroup processes
+    */
+    class ConstantBlackScholesProcess : public StochasticProcess1D {
+      public:
+        ConstantBlackScholesProcess(Real x0,
+                                    Rate riskFreeRate,
+                                    Rate dividendYield,
+                                    Volatility volatility);
+        //! \name StochasticProcess1D interface
+        //@{
+        Real x0() const;
+        /*! \f$ r - q - \sigma^2/2 \f$, independently of t and x */
+        Real drift(Time t, Real x) const;
+        /*! \f$ \sigma \f$, independently of t and x */
+        Real diffusion(Time t, Real x) const;
+        Real expectation(Time t0, Real x0, Time dt) const;
+        Real stdDeviation(Time t0, Real x0, Time dt) const;
+        Real variance(Time t0, Real x0, Time dt) const;
+        Real evolve(Time t0, Real x0, Time dt, Real dw) const;
+        Real apply(Real x0, Real dx) const;
+        //@}
+        //! \name Inspectors
+        //@{
+        Rate riskFreeRate() const { return r_; }
+        Rate dividendYield() const { return q_; }
+        Volatility volatility() const { return sigma_; }
+        //@}
+      private:
+        Real x0_;
+        Rate r_, q_;
+        Volatility sigma_;
+        Real logDrift_;
     };
 
+
+    //! constant-coefficient snapshot of a Black-Scholes process
+    /*! The returned process reproduces the terminal distribution of
+        the given one at the given maturity; r and q are the continuous
+        zero rates and sigma the Black volatility at that maturity.
+        The volatility is read at the given strike, or at the current
+        value of the underlying if no strike is passed.
+    */
+    boost::shared_ptr<ConstantBlackScholesProcess>
+    makeConstantBlackScholesProcess(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Time maturity,
+             Real strike = Null<Real>());
+
 }
 
+
+#endif
@@ -0,0 +1,178 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file counterbasedrng.hpp
+    \brief Counter-based random-number generation for Monte Carlo
+*/
+
+#ifndef counter_based_rng_hpp
+#define counter_based_rng_hpp
+
+#include <ql/math/randomnumbers/rngtraits.hpp>
+#include <ql/math/randomnumbers/seedgenerator.hpp>
+#include <ql/methods/montecarlo/sample.hpp>
+#include <boost/cstdint.hpp>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Philox-4x32-10 uniform random-sequence generator
+    /*! The i-th sequence is a function of the seed and of i alone;
+        therefore, the generator can be started at any sequence
+        without generating the ones before it, and different
+        sequences never overlap.
+
+        Uniform deviates have 32 bits of randomness and lie in the
+        open interval (0,1), as in MersenneTwisterUniformRng.
+
+        See J.K. Salmon, M.A. Moraes, R.O. Dror and D.E. Shaw,
+        "Parallel random numbers: as easy as 1, 2, 3", SC11 (2011).
+
+        \ingroup mcarlo
+    */
+    class PhiloxUniformRsg {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        /*! if the given seed is 0, a random seed is chosen. */
+        explicit PhiloxUniformRsg(Size dimensionality,
+                                  BigNatural seed = 0,
+                                  BigNatural firstSequence = 0);
+        const sample_type& nextSequence() const;
+        const sample_type& lastSequence() const { return sequence_; }
+        Size dimension() const { return dimensionality_; }
+        //! index of the sequence that will be returned next
+        BigNatural nextSequenceIndex() const { return next_; }
+        //! the next call to nextSequence() will return the n-th sequence
+        void skipTo(BigNatural n) { next_ = n; }
+        //! the Philox-4x32 bijection, applied in place to the counter
+        static void philox(boost::uint32_t counter[4],
+                           const boost::uint32_t key[2]);
+      private:
+        Size dimensionality_;
+        boost::uint32_t key_[2];
+        mutable BigNatural next_;
+        mutable sample_type sequence_;
+    };
+
+
+    //! counter-based random-number policy
+    /*! It can be used wherever GenericPseudoRandom is, e.g., as the
+        RNG parameter of MCEuropeanEngine_2; the resulting sequence
+        generator plugs into the PathGenerator typedefs of the
+        Monte Carlo traits.
+    */
+    template <class IC>
+    struct GenericCounterBasedRandom {
+        // typedefs
+        typedef PhiloxUniformRsg ursg_type;
+        typedef InverseCumulativeRsg<ursg_type,IC> rsg_type;
+        // more traits
+        enum { allowsErrorEstimate = 1 };
+        // factory
+        static rsg_type make_sequence_generator(Size dimension,
+                                                BigNatural seed,
+                                                BigNatural firstSequence = 0) {
+            ursg_type g(dimension, seed, firstSequence);
+            return (icInstance ? rsg_type(g, *icInstance) : rsg_type(g));
+        }
+        // data
+        static boost::shared_ptr<IC> icInstance;
+    };
+
+    // static member definitions
+
+    template <class IC>
+    boost::shared_ptr<IC> GenericCounterBasedRandom<IC>::icInstance;
+
+
+    //! default counter-based traits
+    typedef GenericCounterBasedRandom<InverseCumulativeNormal>
+                                                        CounterBasedRandom;
+
+
+    //! random-access capability of random-number policies
+    /*! Policies for which allowsRandomAccess is true can build a
+        generator whose first sequence is an arbitrary one of their
+        stream at no cost. By default, sequences can only be drawn in
+        order; a generator starting at a later sequence draws and
+        discards the ones before it.
+    */
+    template <class RNG>
+    struct RandomAccessTraits {
+        enum { allowsRandomAccess = 0 };
+        static typename RNG::rsg_type
+        make_sequence_generator(Size dimension, BigNatural seed,
+                                BigNatural firstSequence) {
+            typename RNG::rsg_type generator =
+                RNG::make_sequence_generator(dimension, seed);
+            for (BigNatural i=0; i<firstSequence; ++i)
+                generator.nextSequence();
+            return generator;
+        }
+    };
+
+    template <class IC>
+    struct RandomAccessTraits<GenericCounterBasedRandom<IC> > {
+        enum { allowsRandomAccess = 1 };
+        static typename GenericCounterBasedRandom<IC>::rsg_type
+        make_sequence_generator(Size dimension, BigNatural seed,
+                                BigNatural firstSequence) {
+            return GenericCounterBasedRandom<IC>::make_sequence_generator(
+                                              dimension, seed, firstSequence);
+        }
+    };
+
+
+    // inline definitions
+
+    inline PhiloxUniformRsg::PhiloxUniformRsg(Size dimensionality,
+                                              BigNatural seed,
+                                              BigNatural firstSequence)
+    : dimensionality_(dimensionality), next_(firstSequence),
+      sequence_(std::vector<Real>(dimensionality), 1.0) {
+        QL_REQUIRE(dimensionality > 0, "null dimensionality given");
+        if (seed == 0)
+            seed = SeedGenerator::instance().get();
+        boost::uint64_t s = seed;
+        key_[0] = boost::uint32_t(s);
+        key_[1] = boost::uint32_t(s >> 32);
+    }
+
+    inline void PhiloxUniformRsg::philox(boost::uint32_t counter[4],
+                                         const boost::uint32_t key[2]) {
+        const boost::uint64_t M0 = 0xD2511F53UL, M1 = 0xCD9E8D57UL;
+        const boost::uint32_t W0 = 0x9E3779B9UL, W1 = 0xBB67AE85UL;
+        boost::uint32_t k0 = key[0], k1 = key[1];
+        for (Size round=0; round<10; ++round) {
+            boost::uint64_t p0 = M0 * counter[0];
+            boost::uint64_t p1 = M1 * counter[2];
+            boost::uint32_t c0 = boost::uint32_t(p1 >> 32) ^ counter[1] ^ k0;
+            boost::uint32_t c2 = boost::uint32_t(p0 >> 32) ^ counter[3] ^ k1;
+            counter[0] = c0;
+            counter[1] = boost::uint32_t(p1);
+            counter[2] = c2;
+            counter[3] = boost::uint32_t(p0);
+            k0 += W0;
+            k1 += W1;
+        }
+    }
+
+    inline const PhiloxUniformRsg::sample_type&
+    PhiloxUniformRsg::nextSequence() const {
+        // counter = (block within sequence, 0, sequence index)
+        boost::uint64_t n = next_++;
+        std::vector<Real>& values = sequence_.value;
+        for (Size j=0; j<dimensionality_; j+=4) {
+            boost::uint32_t c[4] = { boost::uint32_t(j/4), 0,
+                                     boost::uint32_t(n),
+                                     boost::uint32_t(n >> 32) };
+            philox(c, key_);
+            for (Size k=0; k<4 && j+k<dimensionality_; ++k)
+                values[j+k] = (Real(c[k]) + 0.5) / 4294967296.0;
+        }
+        return sequence_;
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,214 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file europeanterminalkernel.hpp
+    \brief Terminal-sampling kernel for European options in a given precision
+*/
+
+#ifndef european_terminal_kernel_hpp
+#define european_terminal_kernel_hpp
+
+#include "constantblackscholesprocess.hpp"
+#include "counterbasedrng.hpp"
+#include <ql/option.hpp>
+#include <ql/math/constants.hpp>
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Discounted European payoffs sampled at maturity
+    /*! The Gaussian variates, the terminal values and the payoffs are
+        computed in the Float type; with float, twice as many values
+        fit in a vector register as with double, and the loops below,
+        which run over contiguous arrays without branches, are written
+        so that the compiler can vectorize them.
+
+        Variates are drawn by the Box-Muller transform from a Philox
+        stream of the given seed; both the cosine and the sine
+        variates of each pair of uniform deviates are used, so that
+        each Philox block yields the variates of four consecutive
+        samples and the stream can be started at any sample. Uniform
+        deviates have 23 bits of randomness, so that they are exactly
+        representable as floats and lie in the open interval (0,1).
+    */
+    template <class Float>
+    class EuropeanTerminalKernel {
+      public:
+        EuropeanTerminalKernel(Option::Type type,
+                               Real strike,
+                               DiscountFactor discount,
+                               const ConstantBlackScholesProcess& process,
+                               Time maturity,
+                               BigNatural seed);
+        //! uniform deviates of Box-Muller pairs [first, first+n)
+        /*! u1 and u2 receive the radius and angle deviates; the k-th
+            pair gives the variates of samples 2k and 2k+1. */
+        void uniforms(BigNatural first, Size n, Float* u1, Float* u2) const;
+        //! the 2n Gaussian variates of n Box-Muller pairs
+        void normals(const Float* u1, const Float* u2, Size n,
+                     Float* variates) const;
+        //! payoffs of n samples, given their Gaussian variates
+        /*! If antithetic paths are required, the payoff of the
+            antithetic of the j-th sample is stored at n+j. */
+        void payoffs(const Float* normals, Size n, bool antithetic,
+                     Float* values) const;
+      private:
+        Float sign_, strike_, discount_, x0_, drift_, stdDev_;
+        boost::uint32_t key_[2];
+    };
+
+
+    //! Monte Carlo model for European options sampled at maturity
+    /*! It provides the addSamples/sampleAccumulator interface of
+        EuropeanBlockModel_2 on top of EuropeanTerminalKernel. Payoffs
+        are computed in the Float type a block at a time, and widened
+        to double before being averaged with their antithetic and
+        added to the statistics, so that no sum is carried in Float.
+    */
+    template <class Float, class S>
+    class EuropeanTerminalModel_2 : private boost::noncopyable {
+      public:
+        EuropeanTerminalModel_2(
+                 const boost::shared_ptr<EuropeanTerminalKernel<Float> >&
+                                                                    kernel,
+                 bool antitheticVariate,
+                 BigNatural firstSample,
+                 Size blockSize);
+        void addSamples(Size samples);
+        const S& sampleAccumulator() const { return sampleAccumulator_; }
+      private:
+        boost::shared_ptr<EuropeanTerminalKernel<Float> > kernel_;
+        bool antitheticVariate_;
+        BigNatural next_;
+        Size blockSize_;
+        S sampleAccumulator_;
+        std::vector<Float> u1_, u2_, normals_, payoffs_;
+        std::vector<Real> values_;
+    };
+
+
+    // inline definitions
+
+    template <class Float>
+    EuropeanTerminalKernel<Float>::EuropeanTerminalKernel(
+                                  Option::Type type,
+                                  Real strike,
+                                  DiscountFactor discount,
+                                  const ConstantBlackScholesProcess& process,
+                                  Time maturity,
+                                  BigNatural seed)
+    : sign_(Float(type == Option::Call ? 1.0 : -1.0)),
+      strike_(Float(strike)), discount_(Float(discount)),
+      x0_(Float(process.x0())),
+      drift_(Float(process.drift(0.0, process.x0())*maturity)),
+      stdDev_(Float(process.stdDeviation(0.0, process.x0(), maturity))) {
+        if (seed == 0)
+            seed = SeedGenerator::instance().get();
+        boost::uint64_t s = seed;
+        key_[0] = boost::uint32_t(s);
+        key_[1] = boost::uint32_t(s >> 32);
+    }
+
+    template <class Float>
+    void EuropeanTerminalKernel<Float>::uniforms(BigNatural first, Size n,
+                                                 Float* u1,
+                                                 Float* u2) const {
+        const Float scale = Float(1.0/8388608.0);
+        Size j = 0;
+        while (j < n) {
+            boost::uint64_t pair = first + j;
+            // counter = (0, 1, block index); the second word keeps the
+            // stream apart from those of PhiloxUniformRsg
+            boost::uint64_t block = pair/2;
+            boost::uint32_t c[4] = { 0, 1, boost::uint32_t(block),
+                                     boost::uint32_t(block >> 32) };
+            PhiloxUniformRsg::philox(c, key_);
+            for (Size k=pair%2; k<2 && j<n; ++k, ++j) {
+                u1[j] = (Float(c[2*k] >> 9) + Float(0.5))*scale;
+                u2[j] = (Float(c[2*k+1] >> 9) + Float(0.5))*scale;
+            }
+        }
+    }
+
+    template <class Float>
+    void EuropeanTerminalKernel<Float>::normals(const Float* u1,
+                                                const Float* u2,
+                                                Size n,
+                                                Float* variates) const {
+        const Float twoPi = Float(2.0*M_PI);
+        for (Size j=0; j<n; ++j) {
+            Float radius = std::sqrt(Float(-2.0)*std::log(u1[j]));
+            Float angle = twoPi*u2[j];
+            variates[2*j] = radius*std::cos(angle);
+            variates[2*j+1] = radius*std::sin(angle);
+        }
+    }
+
+    template <class Float>
+    void EuropeanTerminalKernel<Float>::payoffs(const Float* normals,
+                                                Size n,
+                                                bool antithetic,
+                                                Float* values) const {
+        const Float x0 = x0_, drift = drift_, stdDev = stdDev_;
+        const Float sign = sign_, strike = strike_, discount = discount_;
+        const Float zero = Float(0.0);
+        for (Size j=0; j<n; ++j) {
+            Float s = x0*std::exp(drift + stdDev*normals[j]);
+            values[j] = discount*std::max(sign*(s-strike), zero);
+        }
+        if (antithetic) {
+            for (Size j=0; j<n; ++j) {
+                Float s = x0*std::exp(drift - stdDev*normals[j]);
+                values[n+j] = discount*std::max(sign*(s-strike), zero);
+            }
+        }
+    }
+
+
+    template <class Float, class S>
+    EuropeanTerminalModel_2<Float,S>::EuropeanTerminalModel_2(
+                 const boost::shared_ptr<EuropeanTerminalKernel<Float> >&
+                                                                    kernel,
+                 bool antitheticVariate,
+                 BigNatural firstSample,
+                 Size blockSize)
+    : kernel_(kernel), antitheticVariate_(antitheticVariate),
+      next_(firstSample), blockSize_(blockSize),
+      u1_(blockSize/2+1), u2_(blockSize/2+1), normals_(blockSize+2),
+      payoffs_(2*blockSize), values_(blockSize) {
+        QL_REQUIRE(blockSize > 0, "null block size given");
+    }
+
+    template <class Float, class S>
+    void EuropeanTerminalModel_2<Float,S>::addSamples(Size samples) {
+        sampleAccumulator_.reserve(sampleAccumulator_.samples() + samples);
+        while (samples > 0) {
+            Size n = std::min(samples, blockSize_);
+            // the block may start at the sine variate of a pair
+            Size offset = Size(next_%2);
+            Size pairs = (offset+n+1)/2;
+            kernel_->uniforms(next_/2, pairs, &u1_[0], &u2_[0]);
+            kernel_->normals(&u1_[0], &u2_[0], pairs, &normals_[0]);
+            kernel_->payoffs(&normals_[offset], n, antitheticVariate_,
+                             &payoffs_[0]);
+            if (antitheticVariate_) {
+                for (Size j=0; j<n; ++j)
+                    values_[j] = (Real(payoffs_[j]) + Real(payoffs_[n+j]))
+                               / 2.0;
+            } else {
+                for (Size j=0; j<n; ++j)
+                    values_[j] = Real(payoffs_[j]);
+            }
+            sampleAccumulator_.addSequence(values_.begin(),
+                                           values_.begin()+n);
+            next_ += n;
+            samples -= n;
+        }
+    }
+
+}
+
+
+#endif
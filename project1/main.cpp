@@ -1,17 +1,834 @@
 
 #include "constantblackscholesprocess.hpp"
 #include "mceuropeanengine.hpp"
+#include "mceuropeanstripengine.hpp"
+#include "mcamericanengine.hpp"
+#include "batchgaussianrng.hpp"
+#include "allocationcounter.hpp"
 #include <ql/pricingengines/vanilla/mceuropeanengine.hpp>
 #include <ql/quantlib.hpp>
 #include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <ctime>
 
 using namespace QuantLib;
 
+namespace {
+
+    // draws per second of the Gaussian sequence generator of a policy
+    template <class RNG>
+    Real gaussianDrawsPerSecond(Size dimension, Size sequences,
+                                Real& checksum) {
+        typename RNG::rsg_type generator =
+            RNG::make_sequence_generator(dimension, 42);
+        std::clock_t start = std::clock();
+        Real sum = 0.0;
+        for (Size i=0; i<sequences; ++i)
+            sum += generator.nextSequence().value[dimension-1];
+        Real elapsed = Real(std::clock() - start) / CLOCKS_PER_SEC;
+        checksum += sum;
+        return dimension*sequences/elapsed;
+    }
+
+    void benchmarkGaussianGenerators() {
+        std::cout << "--------------Gaussian generators (draws/sec)"
+                     "--------------" << std::endl;
+        Real checksum = 0.0;
+        Size dimensions[] = { 1, 16, 256 };
+        for (Size i=0; i<LENGTH(dimensions); ++i) {
+            Size dimension = dimensions[i];
+            Size sequences = 10000000 / dimension;
+            Real pseudo = gaussianDrawsPerSecond<PseudoRandom>(
+                                          dimension, sequences, checksum);
+            Real batch = gaussianDrawsPerSecond<BatchGaussianRandom>(
+                                          dimension, sequences, checksum);
+            std::cout << "dimension " << dimension
+                      << "  PseudoRandom: " << pseudo
+                      << "  BatchGaussianRandom: " << batch
+                      << "  speedup: " << batch/pseudo << std::endl;
+        }
+        std::cout << "(checksum " << checksum << ")" << std::endl
+                  << std::endl;
+    }
+
+    // flat Black-Scholes market used by the checks below
+    boost::shared_ptr<BlackScholesMertonProcess> flatProcess(
+                                        const Handle<Quote>& spot,
+                                        const Handle<Quote>& vol =
+                                            Handle<Quote>()) {
+        Calendar calendar = TARGET();
+        DayCounter dayCounter = Actual365Fixed();
+        Date today = Settings::instance().evaluationDate();
+        Handle<YieldTermStructure> riskFree(
+            boost::shared_ptr<YieldTermStructure>(
+                               new FlatForward(today, 0.05, dayCounter)));
+        Handle<YieldTermStructure> dividends(
+            boost::shared_ptr<YieldTermStructure>(
+                               new FlatForward(today, 0.02, dayCounter)));
+        Handle<BlackVolTermStructure> volatility(
+            vol.empty() ?
+            boost::shared_ptr<BlackVolTermStructure>(
+                new BlackConstantVol(today, calendar, 0.20, dayCounter)) :
+            boost::shared_ptr<BlackVolTermStructure>(
+                new BlackConstantVol(today, calendar, vol, dayCounter)));
+        return boost::shared_ptr<BlackScholesMertonProcess>(
+            new BlackScholesMertonProcess(spot, dividends, riskFree,
+                                          volatility));
+    }
+
+    boost::shared_ptr<VanillaOption> oneYearOption(Option::Type type,
+                                                   Real strike) {
+        Date today = Settings::instance().evaluationDate();
+        return boost::shared_ptr<VanillaOption>(new VanillaOption(
+            boost::shared_ptr<StrikedTypePayoff>(
+                                  new PlainVanillaPayoff(type, strike)),
+            boost::shared_ptr<Exercise>(
+                          new EuropeanExercise(today + Period(1, Years)))));
+    }
+
+    /* The control variate must lower the error estimate of calls and
+       puts, in and out of the money, both per path and in blocks; the
+       paths are the same with and without it. */
+    void checkControlVariate() {
+        std::cout << "--------------Control variate"
+                     "--------------" << std::endl;
+        Handle<Quote> spot(boost::shared_ptr<Quote>(new SimpleQuote(100.0)));
+        boost::shared_ptr<BlackScholesMertonProcess> process =
+            flatProcess(spot);
+        Option::Type types[] = { Option::Call, Option::Put };
+        Real strikes[] = { 80.0, 100.0, 120.0 };
+        Size blockSizes[] = { 0, 4096 };
+        for (Size i=0; i<LENGTH(types); ++i) {
+            for (Size j=0; j<LENGTH(strikes); ++j) {
+                boost::shared_ptr<VanillaOption> option =
+                    oneYearOption(types[i], strikes[j]);
+                option->setPricingEngine(boost::shared_ptr<PricingEngine>(
+                                     new AnalyticEuropeanEngine(process)));
+                Real analytic = option->NPV();
+                for (Size b=0; b<LENGTH(blockSizes); ++b) {
+                    Real npv[2], error[2];
+                    for (Size k=0; k<2; ++k) {
+                        option->setPricingEngine(
+                            MakeMCEuropeanEngine_2<PseudoRandom>(process)
+                            .withTerminalSampling()
+                            .withSamples(100000)
+                            .withSeed(42)
+                            .withBlockSimulation(blockSizes[b])
+                            .withControlVariate(
+                                k == 0 ? EuropeanControlVariate::None :
+                                    EuropeanControlVariate::DiscountedForward));
+                        npv[k] = option->NPV();
+                        error[k] = option->errorEstimate();
+                    }
+                    std::cout << (types[i] == Option::Call ? "call " : "put ")
+                              << strikes[j]
+                              << (blockSizes[b] == 0 ? "  per path" :
+                                                       "  in blocks")
+                              << "  plain: " << npv[0] << " +/- " << error[0]
+                              << "  controlled: " << npv[1]
+                              << " +/- " << error[1]
+                              << "  coefficient: "
+                              << option->result<Real>(
+                                             "controlVariateCoefficient")
+                              << "  analytic: " << analytic << std::endl;
+                    QL_REQUIRE(error[1] < error[0],
+                               "control variate raised the error estimate ("
+                               << error[1] << " against " << error[0] << ")");
+                    QL_REQUIRE(std::fabs(npv[1]-analytic) <= 3.0*error[1],
+                               "controlled price " << npv[1]
+                               << " too far from analytic " << analytic);
+                }
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    /* A strip of calls and puts priced on a single simulation: each
+       price must lie within three of its error estimates of the
+       analytic one. */
+    void checkStripPricing() {
+        std::cout << "--------------Strike strip"
+                     "--------------" << std::endl;
+        Handle<Quote> spot(boost::shared_ptr<Quote>(new SimpleQuote(100.0)));
+        boost::shared_ptr<BlackScholesMertonProcess> process =
+            flatProcess(spot);
+        Date maturity =
+            Settings::instance().evaluationDate() + Period(1, Years);
+        std::vector<boost::shared_ptr<PlainVanillaPayoff> > payoffs;
+        for (Size i=0; i<7; ++i) {
+            Real strike = 70.0 + 10.0*i;
+            payoffs.push_back(boost::shared_ptr<PlainVanillaPayoff>(
+                            new PlainVanillaPayoff(Option::Call, strike)));
+            payoffs.push_back(boost::shared_ptr<PlainVanillaPayoff>(
+                            new PlainVanillaPayoff(Option::Put, strike)));
+        }
+        boost::shared_ptr<MCEuropeanStripEngine_2<PseudoRandom> > engine =
+            MakeMCEuropeanStripEngine_2<PseudoRandom>(process, payoffs,
+                                                      maturity)
+            .withSamples(200000)
+            .withAntitheticVariate()
+            .withSeed(42);
+        engine->calculate();
+        const std::vector<Real>& values = engine->values();
+        const std::vector<Real>& errors = engine->errorEstimates();
+
+        for (Size i=0; i<payoffs.size(); ++i) {
+            VanillaOption option(payoffs[i], boost::shared_ptr<Exercise>(
+                                           new EuropeanExercise(maturity)));
+            option.setPricingEngine(boost::shared_ptr<PricingEngine>(
+                                     new AnalyticEuropeanEngine(process)));
+            Real analytic = option.NPV();
+            std::cout << (payoffs[i]->optionType() == Option::Call ?
+                          "call " : "put ")
+                      << payoffs[i]->strike()
+                      << "  strip: " << values[i] << " +/- " << errors[i]
+                      << "  analytic: " << analytic << std::endl;
+            QL_REQUIRE(std::fabs(values[i]-analytic) <= 3.0*errors[i],
+                       "strip price " << values[i] << " at strike "
+                       << payoffs[i]->strike() << " too far from analytic "
+                       << analytic);
+        }
+        std::cout << engine->samples() << " samples" << std::endl
+                  << std::endl;
+    }
+
+    /* Pathwise delta and vega and mixed-estimator gamma against the
+       analytic Greeks: each must lie within three of its error
+       estimates of the latter. */
+    void checkMonteCarloGreeks() {
+        std::cout << "--------------Monte Carlo Greeks"
+                     "--------------" << std::endl;
+        Handle<Quote> spot(boost::shared_ptr<Quote>(new SimpleQuote(100.0)));
+        boost::shared_ptr<BlackScholesMertonProcess> process =
+            flatProcess(spot);
+        Option::Type types[] = { Option::Call, Option::Put };
+        const char* names[] = { "delta", "gamma", "vega" };
+        for (Size i=0; i<LENGTH(types); ++i) {
+            boost::shared_ptr<VanillaOption> option =
+                oneYearOption(types[i], 105.0);
+            option->setPricingEngine(boost::shared_ptr<PricingEngine>(
+                                     new AnalyticEuropeanEngine(process)));
+            Real analytic[] = { option->delta(), option->gamma(),
+                                option->vega() };
+
+            option->setPricingEngine(
+                MakeMCEuropeanEngine_2<PseudoRandom>(process)
+                .withTerminalSampling()
+                .withSamples(500000)
+                .withSeed(42)
+                .withGreeks());
+            Real estimates[] = { option->delta(), option->gamma(),
+                                 option->vega() };
+            Real errors[] = {
+                option->result<Real>("deltaErrorEstimate"),
+                option->result<Real>("gammaErrorEstimate"),
+                option->result<Real>("vegaErrorEstimate") };
+            for (Size k=0; k<LENGTH(names); ++k) {
+                std::cout << (types[i] == Option::Call ? "call " : "put ")
+                          << names[k] << "  Monte Carlo: " << estimates[k]
+                          << " +/- " << errors[k]
+                          << "  analytic: " << analytic[k] << std::endl;
+                QL_REQUIRE(std::fabs(estimates[k]-analytic[k])
+                                                       <= 3.0*errors[k],
+                           "Monte Carlo " << names[k] << " " << estimates[k]
+                           << " too far from analytic " << analytic[k]);
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    /* Randomized quasi-Monte Carlo: a tolerance-driven run must reach
+       the analytic price within three of its spread-based error
+       estimates, and at an equal number of points its error must be
+       below that of pseudo-random sampling. */
+    void checkRandomizedQuasiMonteCarlo() {
+        std::cout << "--------------Randomized quasi-Monte Carlo"
+                     "--------------" << std::endl;
+        Handle<Quote> spot(boost::shared_ptr<Quote>(new SimpleQuote(100.0)));
+        boost::shared_ptr<BlackScholesMertonProcess> process =
+            flatProcess(spot);
+        boost::shared_ptr<VanillaOption> option =
+            oneYearOption(Option::Call, 100.0);
+        option->setPricingEngine(boost::shared_ptr<PricingEngine>(
+                                     new AnalyticEuropeanEngine(process)));
+        Real analytic = option->NPV();
+
+        option->setPricingEngine(
+            MakeMCEuropeanEngine_2<RandomizedLowDiscrepancy>(process)
+            .withSteps(10)
+            .withBrownianBridge()
+            .withAbsoluteTolerance(0.005)
+            .withSeed(42)
+            .withThreads(4));
+        Real npv = option->NPV();
+        Real error = option->errorEstimate();
+        std::cout << "tolerance 0.005: " << npv << " +/- " << error
+                  << "  analytic: " << analytic << std::endl;
+        QL_REQUIRE(error <= 0.005,
+                   "randomized run missed the tolerance: error " << error);
+        QL_REQUIRE(std::fabs(npv-analytic) <= 3.0*error,
+                   "randomized price " << npv
+                   << " too far from analytic " << analytic);
+
+        // 16 randomizations of 4096 points
+        Size points = 65536;
+        option->setPricingEngine(
+            MakeMCEuropeanEngine_2<RandomizedLowDiscrepancy>(process)
+            .withSteps(10)
+            .withBrownianBridge()
+            .withSamples(points)
+            .withSeed(42)
+            .withThreads(4));
+        Real quasiNpv = option->NPV();
+        Real quasiError = option->errorEstimate();
+        option->setPricingEngine(
+            MakeMCEuropeanEngine_2<PseudoRandom>(process)
+            .withSteps(10)
+            .withBrownianBridge()
+            .withSamples(points)
+            .withSeed(42));
+        Real pseudoNpv = option->NPV();
+        Real pseudoError = option->errorEstimate();
+        std::cout << points << " points  randomized: " << quasiNpv
+                  << " +/- " << quasiError
+                  << "  pseudo-random: " << pseudoNpv
+                  << " +/- " << pseudoError << std::endl << std::endl;
+        QL_REQUIRE(quasiError < pseudoError,
+                   "randomized error " << quasiError
+                   << " not below pseudo-random error " << pseudoError);
+    }
+
+    /* Importance sampling of deep out-of-the-money options: the price
+       must lie within three error estimates of the analytic one and
+       the reported variance reduction must be above 1. */
+    void checkImportanceSampling() {
+        std::cout << "--------------Importance sampling"
+                     "--------------" << std::endl;
+        Handle<Quote> spot(boost::shared_ptr<Quote>(new SimpleQuote(100.0)));
+        boost::shared_ptr<BlackScholesMertonProcess> process =
+            flatProcess(spot);
+        Option::Type types[] = { Option::Call, Option::Put };
+        Real strikes[] = { 160.0, 60.0 };
+        for (Size i=0; i<LENGTH(types); ++i) {
+            boost::shared_ptr<VanillaOption> option =
+                oneYearOption(types[i], strikes[i]);
+            option->setPricingEngine(boost::shared_ptr<PricingEngine>(
+                                     new AnalyticEuropeanEngine(process)));
+            Real analytic = option->NPV();
+            option->setPricingEngine(
+                MakeMCEuropeanEngine_2<PseudoRandom>(process)
+                .withTerminalSampling()
+                .withSamples(200000)
+                .withSeed(42)
+                .withImportanceSampling());
+            Real npv = option->NPV();
+            Real error = option->errorEstimate();
+            Real reduction = option->result<Real>("varianceReduction");
+            std::cout << (types[i] == Option::Call ? "call " : "put ")
+                      << strikes[i] << "  importance sampling: " << npv
+                      << " +/- " << error << "  analytic: " << analytic
+                      << "  variance reduction: " << reduction << std::endl;
+            QL_REQUIRE(std::fabs(npv-analytic) <= 3.0*error,
+                       "importance-sampled price " << npv
+                       << " too far from analytic " << analytic);
+            QL_REQUIRE(reduction > 1.0,
+                       "no variance reduction (" << reduction << ")");
+        }
+        std::cout << std::endl;
+    }
+
+    /* Stratified sampling and moment matching of the terminal variate
+       must lower the error estimate against plain sampling of as many
+       paths, and keep the price within three error estimates of the
+       analytic one. */
+    void checkTerminalVariateSampling() {
+        std::cout << "--------------Stratified sampling and moment matching"
+                     "--------------" << std::endl;
+        Handle<Quote> spot(boost::shared_ptr<Quote>(new SimpleQuote(100.0)));
+        boost::shared_ptr<BlackScholesMertonProcess> process =
+            flatProcess(spot);
+        boost::shared_ptr<VanillaOption> option =
+            oneYearOption(Option::Call, 100.0);
+        option->setPricingEngine(boost::shared_ptr<PricingEngine>(
+                                     new AnalyticEuropeanEngine(process)));
+        Real analytic = option->NPV();
+
+        Size paths = 200000;
+        const char* names[] = { "plain", "stratified", "moment matching" };
+        Real npv[3], error[3];
+        for (Size k=0; k<LENGTH(names); ++k) {
+            MakeMCEuropeanEngine_2<PseudoRandom> engine(process);
+            engine.withTerminalSampling()
+                  .withSamples(paths)
+                  .withSeed(42)
+                  .withBlockSimulation();
+            if (k == 1)
+                engine.withStratifiedSampling(16);
+            else if (k == 2)
+                engine.withMomentMatching(64);
+            option->setPricingEngine(engine);
+            npv[k] = option->NPV();
+            error[k] = option->errorEstimate();
+            std::cout << names[k] << ": " << npv[k] << " +/- " << error[k]
+                      << "  analytic: " << analytic << std::endl;
+            QL_REQUIRE(std::fabs(npv[k]-analytic) <= 3.0*error[k],
+                       names[k] << " price " << npv[k]
+                       << " too far from analytic " << analytic);
+            QL_REQUIRE(k == 0 || error[k] < error[0],
+                       names[k] << " error " << error[k]
+                       << " not below plain error " << error[0]);
+        }
+        std::cout << std::endl;
+    }
+
+    // heap allocations made when repricing with a given engine
+    Size repricingAllocations(VanillaOption& option,
+                              const boost::shared_ptr<PricingEngine>& engine) {
+        option.setPricingEngine(engine);
+        option.NPV();                // sizes the arena
+        AllocationCounter counter;
+        option.recalculate();
+        return counter.allocations();
+    }
+
+    /* In block simulation, the allocations are made while setting up
+       the calculation; their number must not depend on the number of
+       samples, i.e., the sample loop must not allocate. */
+    void checkSteadyStateAllocations() {
+        std::cout << "--------------Allocations per calculation"
+                     "--------------" << std::endl;
+        Handle<Quote> spot(boost::shared_ptr<Quote>(new SimpleQuote(100.0)));
+        boost::shared_ptr<BlackScholesMertonProcess> process =
+            flatProcess(spot);
+        boost::shared_ptr<VanillaOption> option =
+            oneYearOption(Option::Call, 100.0);
+
+        Size samples[] = { 10000, 100000, 1000000 };
+        Size allocations[LENGTH(samples)];
+        for (Size i=0; i<LENGTH(samples); ++i) {
+            boost::shared_ptr<PricingEngine> engine =
+                MakeMCEuropeanEngine_2<PseudoRandom>(process)
+                .withSteps(10)
+                .withSamples(samples[i])
+                .withSeed(42)
+                .withBlockSimulation();
+            allocations[i] = repricingAllocations(*option, engine);
+            std::cout << samples[i] << " samples: "
+                      << allocations[i] << " allocations" << std::endl;
+            QL_REQUIRE(allocations[i] == allocations[0],
+                       "allocations depend on the number of samples ("
+                       << allocations[i] << " for " << samples[i]
+                       << " samples, " << allocations[0] << " for "
+                       << samples[0] << ")");
+        }
+        std::cout << std::endl;
+    }
+
+    // seconds taken by a (re)calculation of the option
+    Real pricingTime(VanillaOption& option, Real& npv) {
+        std::clock_t start = std::clock();
+        npv = option.NPV();
+        return Real(std::clock() - start) / CLOCKS_PER_SEC;
+    }
+
+    /* A spot move reprices the stored samples; a volatility or rate
+       move would trigger a new simulation. */
+    void benchmarkIncrementalRepricing() {
+        std::cout << "--------------Spot re-marks (seconds)"
+                     "--------------" << std::endl;
+        boost::shared_ptr<SimpleQuote> quote(new SimpleQuote(100.0));
+        boost::shared_ptr<BlackScholesMertonProcess> process =
+            flatProcess(Handle<Quote>(quote));
+        boost::shared_ptr<VanillaOption> full =
+            oneYearOption(Option::Call, 100.0);
+        boost::shared_ptr<VanillaOption> incremental =
+            oneYearOption(Option::Call, 100.0);
+        full->setPricingEngine(
+            MakeMCEuropeanEngine_2<PseudoRandom>(process)
+            .withTerminalSampling()
+            .withSamples(1000000)
+            .withAntitheticVariate()
+            .withSeed(42)
+            .withBlockSimulation());
+        incremental->setPricingEngine(
+            MakeMCEuropeanEngine_2<PseudoRandom>(process)
+            .withTerminalSampling()
+            .withSamples(1000000)
+            .withAntitheticVariate()
+            .withSeed(42)
+            .withIncrementalRepricing());
+
+        Real spots[] = { 100.0, 100.5, 99.8, 101.2 };
+        for (Size i=0; i<LENGTH(spots); ++i) {
+            quote->setValue(spots[i]);
+            Real fullNpv, incrementalNpv;
+            Real fullTime = pricingTime(*full, fullNpv);
+            Real incrementalTime = pricingTime(*incremental, incrementalNpv);
+            std::cout << "spot " << spots[i]
+                      << "  full: " << fullNpv << " (" << fullTime << ")"
+                      << "  incremental: " << incrementalNpv
+                      << " (" << incrementalTime << ")" << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+    /* A finite-difference vega ladder on a 50-step grid: with common
+       random numbers, every bumped calculation reads the Gaussian
+       draws of the first one from the cache. */
+    void benchmarkCommonRandomNumbers() {
+        std::cout << "--------------Vega ladder (seconds)"
+                     "--------------" << std::endl;
+        boost::shared_ptr<SimpleQuote> vol(new SimpleQuote(0.20));
+        Handle<Quote> spot(boost::shared_ptr<Quote>(new SimpleQuote(100.0)));
+        boost::shared_ptr<BlackScholesMertonProcess> process =
+            flatProcess(spot, Handle<Quote>(vol));
+        boost::shared_ptr<VanillaOption> plain =
+            oneYearOption(Option::Call, 100.0);
+        boost::shared_ptr<VanillaOption> common =
+            oneYearOption(Option::Call, 100.0);
+        plain->setPricingEngine(
+            MakeMCEuropeanEngine_2<PseudoRandom>(process)
+            .withSteps(50)
+            .withSamples(100000)
+            .withSeed(42)
+            .withBlockSimulation());
+        common->setPricingEngine(
+            MakeMCEuropeanEngine_2<PseudoRandom>(process)
+            .withSteps(50)
+            .withSamples(100000)
+            .withSeed(42)
+            .withCommonRandomNumbers());
+
+        NormalDrawCache::instance().clear();
+        Real bump = 0.001;
+        Real vols[] = { 0.20, 0.20+bump, 0.20-bump };
+        Real plainNpv[3], commonNpv[3];
+        for (Size i=0; i<LENGTH(vols); ++i) {
+            vol->setValue(vols[i]);
+            Real plainTime = pricingTime(*plain, plainNpv[i]);
+            Real commonTime = pricingTime(*common, commonNpv[i]);
+            std::cout << "volatility " << vols[i]
+                      << "  plain: " << plainNpv[i] << " (" << plainTime << ")"
+                      << "  common: " << commonNpv[i]
+                      << " (" << commonTime << ")" << std::endl;
+        }
+        std::cout << "vega  plain: " << (plainNpv[1]-plainNpv[2])/(2*bump)
+                  << "  common: " << (commonNpv[1]-commonNpv[2])/(2*bump)
+                  << std::endl
+                  << "cached draws: "
+                  << NormalDrawCache::instance().memoryUsed()/(1024*1024)
+                  << " MB" << std::endl << std::endl;
+    }
+
+    /* The first run is stopped after its first batch of 1023 samples,
+       as a preempted job would be, and leaves its checkpoint behind;
+       the second resumes from it and must match a run that was never
+       interrupted. */
+    void checkCheckpointResume() {
+        std::cout << "--------------Checkpoint and resume"
+                     "--------------" << std::endl;
+        Handle<Quote> spot(boost::shared_ptr<Quote>(new SimpleQuote(100.0)));
+        boost::shared_ptr<BlackScholesMertonProcess> process =
+            flatProcess(spot);
+        std::string file = "mceuropean.checkpoint";
+        std::remove(file.c_str());
+
+        boost::shared_ptr<VanillaOption> option =
+            oneYearOption(Option::Call, 100.0);
+        option->setPricingEngine(
+            MakeMCEuropeanEngine_2<CounterBasedRandom>(process)
+            .withSteps(10)
+            .withAbsoluteTolerance(0.05)
+            .withMaxSamples(1023)
+            .withSeed(42)
+            .withThreads(2)
+            .withCheckpoint(file, 10000));
+        try {
+            option->NPV();
+        } catch (std::exception&) {
+            std::cout << "interrupted after 1023 samples" << std::endl;
+        }
+
+        Real npv[2];
+        for (Size i=0; i<2; ++i) {
+            // the first calculation resumes, the second starts afresh
+            option->setPricingEngine(
+                MakeMCEuropeanEngine_2<CounterBasedRandom>(process)
+                .withSteps(10)
+                .withAbsoluteTolerance(0.05)
+                .withSeed(42)
+                .withThreads(2)
+                .withCheckpoint(file, 10000));
+            npv[i] = option->NPV();
+        }
+        std::cout << std::setprecision(17)
+                  << "resumed: " << npv[0] << std::endl
+                  << "uninterrupted: " << npv[1] << std::endl
+                  << std::setprecision(6) << std::endl;
+        QL_REQUIRE(npv[0] == npv[1],
+                   "resumed price differs from uninterrupted one");
+    }
+
+    // discounted call payoff at a quantile of the log-normal spot
+    Real callPayoffQuantile(Real forward, Real stdDev,
+                            DiscountFactor discount, Real strike,
+                            Real level) {
+        InverseCumulativeNormal inverse;
+        Real terminal = forward * std::exp(-0.5*stdDev*stdDev
+                                           + stdDev*inverse(level));
+        return discount * std::max(terminal - strike, 0.0);
+    }
+
+    /* Sketched quantiles of the discounted payoff against the exact
+       ones, i.e., the discounted payoff at the log-normal quantiles
+       of the terminal spot. The tolerance is set on the level: the
+       sketched quantile must lie between the exact ones at levels a
+       few sampling standard deviations, plus the rank error of the
+       sketch, away. */
+    void checkPayoffQuantiles() {
+        std::cout << "--------------Payoff quantiles"
+                     "--------------" << std::endl;
+        Handle<Quote> spot(boost::shared_ptr<Quote>(new SimpleQuote(100.0)));
+        boost::shared_ptr<BlackScholesMertonProcess> process =
+            flatProcess(spot);
+        boost::shared_ptr<VanillaOption> option =
+            oneYearOption(Option::Call, 100.0);
+        Real levels[] = { 0.5, 0.9, 0.99, 0.999 };
+        std::vector<Real> quantileLevels(levels, levels+LENGTH(levels));
+        Size samples = 1000000;
+        option->setPricingEngine(
+            MakeMCEuropeanEngine_2<CounterBasedRandom>(process)
+            .withTerminalSampling()
+            .withSamples(samples)
+            .withSeed(42)
+            .withThreads(4)
+            .withQuantiles(quantileLevels));
+        option->NPV();
+        std::vector<Real> quantiles =
+            option->result<std::vector<Real> >("payoffQuantiles");
+        std::vector<Real> shortfalls =
+            option->result<std::vector<Real> >("expectedShortfall");
+
+        Time T = process->time(option->exercise()->lastDate());
+        DiscountFactor discount = process->riskFreeRate()->discount(T);
+        Real forward = spot->value()
+            * process->dividendYield()->discount(T) / discount;
+        Real stdDev = std::sqrt(process->blackVolatility()->blackVariance(
+                                                               T, 100.0));
+        for (Size i=0; i<quantileLevels.size(); ++i) {
+            Real p = levels[i];
+            Real exact = callPayoffQuantile(forward, stdDev, discount,
+                                            100.0, p);
+            std::cout << "level " << p
+                      << "  sketch: " << quantiles[i]
+                      << "  exact: " << exact
+                      << "  expected shortfall: " << shortfalls[i]
+                      << std::endl;
+            Real tolerance = 5.0*std::sqrt(p*(1.0-p)/samples)
+                           + p*(1.0-p)/100.0;
+            Real low = callPayoffQuantile(forward, stdDev, discount,
+                                          100.0, p - tolerance);
+            Real high = callPayoffQuantile(forward, stdDev, discount,
+                                           100.0, p + tolerance);
+            QL_REQUIRE(quantiles[i] >= low && quantiles[i] <= high,
+                       "sketched quantile at level " << p << " ("
+                       << quantiles[i] << ") outside [" << low << ", "
+                       << high << "]");
+        }
+        std::cout << std::endl;
+    }
+
+    // wall-clock seconds taken by a calculation of the option
+    Real wallTime(VanillaOption& option, Real& npv) {
+        boost::posix_time::ptime start =
+            boost::posix_time::microsec_clock::universal_time();
+        npv = option.NPV();
+        boost::posix_time::time_duration elapsed =
+            boost::posix_time::microsec_clock::universal_time() - start;
+        return elapsed.total_microseconds()/1.0e6;
+    }
+
+    /* A tolerance-driven run with the default schedule against one
+       planned after a pilot run, both on four threads. */
+    void benchmarkSamplePlanner() {
+        std::cout << "--------------Pilot-run planner"
+                     "--------------" << std::endl;
+        Handle<Quote> spot(boost::shared_ptr<Quote>(new SimpleQuote(100.0)));
+        boost::shared_ptr<BlackScholesMertonProcess> process =
+            flatProcess(spot);
+        boost::shared_ptr<VanillaOption> option =
+            oneYearOption(Option::Call, 100.0);
+        Real tolerance = 0.01;
+
+        option->setPricingEngine(
+            MakeMCEuropeanEngine_2<CounterBasedRandom>(process)
+            .withSteps(10)
+            .withAbsoluteTolerance(tolerance)
+            .withSeed(42)
+            .withThreads(4)
+            .withBlockSimulation());
+        Real npv;
+        Real defaultTime = wallTime(*option, npv);
+        std::cout << "default schedule: " << npv
+                  << "  error: " << option->errorEstimate()
+                  << "  wall time: " << defaultTime << std::endl;
+
+        option->setPricingEngine(
+            MakeMCEuropeanEngine_2<CounterBasedRandom>(process)
+            .withSteps(10)
+            .withAbsoluteTolerance(tolerance)
+            .withSeed(42)
+            .withThreads(4)
+            .withBlockSimulation()
+            .withPilotRun(10000));
+        Real plannedTime = wallTime(*option, npv);
+        Real error = option->errorEstimate();
+        std::cout << "planned: " << npv
+                  << "  samples: " << option->result<Size>("plannedSamples")
+                  << "  predicted error: "
+                  << option->result<Real>("predictedErrorEstimate")
+                  << "  achieved error: " << error
+                  << "  wall time: " << plannedTime
+                  << std::endl << std::endl;
+        QL_REQUIRE(error <= tolerance,
+                   "planned run missed the tolerance: error " << error
+                   << ", tolerance " << tolerance);
+    }
+
+    /* Validation of the single-precision kernel: on a set of options,
+       its price must agree with that of the double-precision engine,
+       and both with the analytic one, within three standard errors. */
+    void validateSinglePrecision() {
+        std::cout << "--------------Single precision validation"
+                     "--------------" << std::endl;
+        Handle<Quote> spot(boost::shared_ptr<Quote>(new SimpleQuote(100.0)));
+        boost::shared_ptr<BlackScholesMertonProcess> process =
+            flatProcess(spot);
+        Option::Type types[] = { Option::Call, Option::Put };
+        Real strikes[] = { 80.0, 100.0, 120.0 };
+        Size failures = 0;
+        Real doubleTime = 0.0, floatTime = 0.0;
+        for (Size i=0; i<LENGTH(types); ++i) {
+            for (Size j=0; j<LENGTH(strikes); ++j) {
+                boost::shared_ptr<VanillaOption> option =
+                    oneYearOption(types[i], strikes[j]);
+                option->setPricingEngine(boost::shared_ptr<PricingEngine>(
+                                     new AnalyticEuropeanEngine(process)));
+                Real analytic = option->NPV();
+
+                Real npv[2], error[2];
+                for (Size k=0; k<2; ++k) {
+                    option->setPricingEngine(
+                        MakeMCEuropeanEngine_2<PseudoRandom>(process)
+                        .withTerminalSampling()
+                        .withSamples(2000000)
+                        .withSeed(42)
+                        .withBlockSimulation()
+                        .withSinglePrecision(k == 1));
+                    Real elapsed = wallTime(*option, npv[k]);
+                    (k == 0 ? doubleTime : floatTime) += elapsed;
+                    error[k] = option->errorEstimate();
+                }
+                Real tolerance = 3.0*std::sqrt(error[0]*error[0]
+                                               + error[1]*error[1]);
+                bool ok = std::fabs(npv[1]-npv[0]) <= tolerance
+                       && std::fabs(npv[1]-analytic) <= 3.0*error[1]
+                       && std::fabs(npv[0]-analytic) <= 3.0*error[0];
+                if (!ok)
+                    ++failures;
+                std::cout << (types[i] == Option::Call ? "call " : "put ")
+                          << strikes[j]
+                          << "  double: " << npv[0] << " +/- " << error[0]
+                          << "  float: " << npv[1] << " +/- " << error[1]
+                          << "  analytic: " << analytic
+                          << (ok ? "" : "  FAILED") << std::endl;
+            }
+        }
+        std::cout << failures << " failures; wall time double: "
+                  << doubleTime << "  float: " << floatTime
+                  << std::endl << std::endl;
+        QL_REQUIRE(failures == 0,
+                   failures << " single-precision validation failures");
+    }
+
+    /* American put priced by Longstaff-Schwartz against a binomial
+       tree, with one and several threads; the counter-based policy
+       gives the same price regardless of the number of threads. The
+       regression price is biased low, since exercise is restricted to
+       the 50 dates of the grid and follows an estimated, suboptimal
+       rule; for this option the bias is a few cents, hence the
+       allowance below the tree price. */
+    void benchmarkAmericanEngine() {
+        std::cout << "--------------Longstaff-Schwartz American put"
+                     "--------------" << std::endl;
+        Handle<Quote> spot(boost::shared_ptr<Quote>(new SimpleQuote(100.0)));
+        boost::shared_ptr<BlackScholesMertonProcess> process =
+            flatProcess(spot);
+        Date today = Settings::instance().evaluationDate();
+        VanillaOption option(
+            boost::shared_ptr<StrikedTypePayoff>(
+                                  new PlainVanillaPayoff(Option::Put, 110.0)),
+            boost::shared_ptr<Exercise>(
+                new AmericanExercise(today, today + Period(1, Years))));
+
+        option.setPricingEngine(boost::shared_ptr<PricingEngine>(
+            new BinomialVanillaEngine<CoxRossRubinstein>(process, 2000)));
+        Real tree = option.NPV();
+        std::cout << "binomial tree: " << tree << std::endl;
+
+        Real lowBias = 0.05;
+        Size threads[] = { 1, 4 };
+        for (Size i=0; i<LENGTH(threads); ++i) {
+            option.setPricingEngine(
+                MakeMCAmericanEngine_2<CounterBasedRandom>(process)
+                .withSteps(50)
+                .withAntitheticVariate()
+                .withSamples(200000)
+                .withCalibrationSamples(50000)
+                .withPolynomialOrder(3)
+                .withSeed(42)
+                .withThreads(threads[i]));
+            Real npv;
+            Real elapsed = wallTime(option, npv);
+            Real error = option.errorEstimate();
+            std::cout << threads[i] << " thread(s): " << npv
+                      << " +/- " << error
+                      << "  difference: " << npv - tree
+                      << "  wall time: " << elapsed << std::endl;
+            QL_REQUIRE(npv >= tree - lowBias - 3.0*error &&
+                       npv <= tree + 3.0*error,
+                       "Longstaff-Schwartz price " << npv
+                       << " inconsistent with tree price " << tree
+                       << " (error " << error << ", low-bias allowance "
+                       << lowBias << ")");
+        }
+        std::cout << std::endl;
+    }
+
+}
+
 int main() {
 
     try {
 
-        // add your code here
+        Settings::instance().evaluationDate() = Date::todaysDate();
+
+        benchmarkGaussianGenerators();
+        checkControlVariate();
+        checkStripPricing();
+        checkMonteCarloGreeks();
+        checkRandomizedQuasiMonteCarlo();
+        checkImportanceSampling();
+        checkTerminalVariateSampling();
+        checkSteadyStateAllocations();
+        benchmarkIncrementalRepricing();
+        benchmarkCommonRandomNumbers();
+        checkCheckpointResume();
+        checkPayoffQuantiles();
+        benchmarkSamplePlanner();
+        validateSinglePrecision();
+        benchmarkAmericanEngine();
 
         return 0;
 
@@ -23,4 +840,3 @@ int main() {
         return 1;
     }
 }
-
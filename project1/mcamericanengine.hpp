@@ -0,0 +1,682 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file mcamericanengine.hpp
+    \brief Longstaff-Schwartz Monte Carlo engine for American options
+*/
+
+#ifndef montecarlo_american_engine_hpp
+#define montecarlo_american_engine_hpp
+
+#include "mceuropeanengine.hpp"
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/math/matrixutilities/svd.hpp>
+
+namespace QuantLib {
+
+    //! Longstaff-Schwartz exercise rule of an American put or call
+    /*! At each exercise time, the continuation value is regressed on
+        a polynomial in the moneyness S/K, using the in-the-money
+        paths only; the option is exercised when the payoff exceeds
+        the regressed continuation value.
+
+        Paths are read in structure-of-arrays layout, i.e., one
+        contiguous array of values for each time of the grid. The
+        regression accumulates its normal equations in a single pass
+        over the array for the given time, evaluating the monomials
+        of each path on the fly; no matrix of basis-function values
+        is ever stored. Continuation values are evaluated by Horner's
+        rule.
+
+        See F.A. Longstaff and E.S. Schwartz, "Valuing American
+        options by simulation: a simple least-squares approach",
+        Review of Financial Studies 14 (2001).
+    */
+    class LongstaffSchwartzRule {
+      public:
+        LongstaffSchwartzRule(Option::Type type,
+                              Real strike,
+                              const std::vector<DiscountFactor>& discounts,
+                              const std::vector<bool>& exercisable,
+                              Size polynomialOrder);
+        //! regression on n paths stored with the given stride
+        /*! The values of the paths at the i-th time are stored in
+            paths[i*stride], ..., paths[i*stride+n-1]; cashFlows
+            must hold n values and is used as working storage.
+        */
+        void calibrate(const Real* paths, Size stride, Size n,
+                       Real* cashFlows);
+        //! discounted payoffs of n paths following the rule
+        /*! The values of the paths at the i-th time are read from
+            path(i); alive must hold n values and is used as working
+            storage. */
+        template <class PathValues>
+        void price(const PathValues& path, Size n,
+                   Real* values, Real* alive) const;
+        Real payoff(Real s) const {
+            return std::max(sign_*(s-strike_), 0.0);
+        }
+        bool calibrated() const { return calibrated_; }
+        const std::vector<Array>& coefficients() const {
+            return coefficients_;
+        }
+      private:
+        Real continuation(const Array& c, Real s) const {
+            Real x = s/strike_, y = c[c.size()-1];
+            for (Size k=c.size()-1; k>0; --k)
+                y = y*x + c[k-1];
+            return y;
+        }
+        Real sign_, strike_;
+        std::vector<DiscountFactor> discounts_;
+        std::vector<bool> exercisable_;
+        Size basisSize_;
+        // empty where no regression could be made
+        std::vector<Array> coefficients_;
+        bool calibrated_;
+    };
+
+
+    namespace detail {
+
+        //! fills a range of a path store, a block at a time
+        template <class GSG>
+        class AmericanPathFiller {
+          public:
+            AmericanPathFiller(
+                  const boost::shared_ptr<BlockPathGenerator<GSG> >& generator,
+                  Real* paths, Size stride, Size first)
+            : generator_(generator), paths_(paths), stride_(stride),
+              next_(first) {}
+            void addSamples(Size samples) {
+                const Size steps = generator_->timeGrid().size();
+                while (samples > 0) {
+                    Size n = std::min(samples, generator_->blockSize());
+                    generator_->next(n);
+                    for (Size i=0; i<steps; ++i)
+                        std::copy(generator_->values(i),
+                                  generator_->values(i) + n,
+                                  paths_ + i*stride_ + next_);
+                    next_ += n;
+                    samples -= n;
+                }
+            }
+          private:
+            boost::shared_ptr<BlockPathGenerator<GSG> > generator_;
+            Real* paths_;
+            Size stride_, next_;
+        };
+
+        //! path values of the current block of a generator
+        template <class Generator>
+        class BlockPathValues {
+          public:
+            explicit BlockPathValues(const Generator& generator)
+            : generator_(generator) {}
+            const Real* operator()(Size i) const {
+                return generator_.values(i);
+            }
+          private:
+            const Generator& generator_;
+        };
+
+    }
+
+
+    //! Monte Carlo model pricing American options on blocks of paths
+    /*! Paths are generated a block at a time and the given exercise
+        rule is applied to the whole block, one time of the grid at a
+        time; it has the same interface as EuropeanBlockModel_2.
+    */
+    template <class RNG, class S>
+    class AmericanBlockModel_2 : private boost::noncopyable {
+      public:
+        typedef BlockPathGenerator<typename RNG::rsg_type>
+                                                    block_generator_type;
+        AmericanBlockModel_2(
+                 const boost::shared_ptr<block_generator_type>& generator,
+                 const boost::shared_ptr<LongstaffSchwartzRule>& rule,
+                 bool antitheticVariate,
+                 MonteCarloArena* arena = 0);
+        void addSamples(Size samples);
+        const S& sampleAccumulator() const { return sampleAccumulator_; }
+      private:
+        boost::shared_ptr<block_generator_type> generator_;
+        boost::shared_ptr<LongstaffSchwartzRule> rule_;
+        bool antitheticVariate_;
+        S sampleAccumulator_;
+        MonteCarloArena ownArena_;
+        Real *values_, *alive_;
+    };
+
+
+    //! American option pricing engine using Longstaff-Schwartz Monte Carlo
+    /*! Each time of the grid after the earliest exercise date is an
+        exercise time, so that the option is priced as a Bermudan one
+        with as many exercise dates as time steps. Paths are drawn in
+        blocks by a BlockPathGenerator from the constant-coefficient
+        snapshot of the process at maturity (see
+        makeConstantBlackScholesProcess), which also gives the
+        discount factors at the exercise times.
+
+        The exercise rule is calibrated on a first set of paths, all
+        of which are kept in structure-of-arrays layout; the option is
+        then priced on a second, independent set, which removes the
+        upward bias of in-sample pricing. Both sets are generated in
+        parallel when more than one thread is given: as in
+        MCEuropeanEngine_2, each set is a single stream split among
+        the threads, which requires a random-number policy allowing
+        random access; the results don't depend on the number of
+        threads. The pricing statistics are merged in thread order.
+
+        \ingroup vanillaengines
+    */
+    template <class RNG = PseudoRandom, class S = Statistics>
+    class MCAmericanEngine_2 : public VanillaOption::engine {
+      public:
+        MCAmericanEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps,
+             Size timeStepsPerYear,
+             bool brownianBridge,
+             bool antitheticVariate,
+             Size requiredSamples,
+             Size calibrationSamples,
+             Size polynomialOrder,
+             BigNatural seed,
+             Size threads = 1,
+             Size blockSize = 4096);
+        void calculate() const;
+      protected:
+        typedef AmericanBlockModel_2<RNG,S> model_type;
+        typedef typename model_type::block_generator_type
+                                                    block_generator_type;
+        TimeGrid timeGrid() const;
+        boost::shared_ptr<LongstaffSchwartzRule> calibrate(
+             const boost::shared_ptr<ConstantBlackScholesProcess>& process,
+             const TimeGrid& grid,
+             BigNatural seed) const;
+        boost::shared_ptr<block_generator_type> blockGenerator(
+             const boost::shared_ptr<ConstantBlackScholesProcess>& process,
+             const TimeGrid& grid,
+             BigNatural seed, BigNatural firstSequence) const;
+        //! seed and first sequence of each thread
+        void threadStreams(BigNatural seed,
+                           std::vector<BigNatural>& seeds,
+                           std::vector<BigNatural>& firstSequences,
+                           Size samples) const;
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size timeSteps_, timeStepsPerYear_;
+        bool brownianBridge_, antitheticVariate_;
+        Size requiredSamples_, calibrationSamples_, polynomialOrder_;
+        BigNatural seed_;
+        Size threads_, blockSize_;
+        //! storage for paths and buffers, reused across calculations
+        mutable MonteCarloArena arena_;
+      private:
+        template <class Model>
+        void runWorkers(const std::vector<boost::shared_ptr<Model> >& workers,
+                        Size samples) const;
+    };
+
+
+    //! Monte Carlo American engine factory
+    template <class RNG = PseudoRandom, class S = Statistics>
+    class MakeMCAmericanEngine_2 {
+      public:
+        MakeMCAmericanEngine_2(
+                    const boost::shared_ptr<GeneralizedBlackScholesProcess>&);
+        // named parameters
+        MakeMCAmericanEngine_2& withSteps(Size steps);
+        MakeMCAmericanEngine_2& withStepsPerYear(Size steps);
+        MakeMCAmericanEngine_2& withBrownianBridge(bool b = true);
+        MakeMCAmericanEngine_2& withAntitheticVariate(bool b = true);
+        MakeMCAmericanEngine_2& withSamples(Size samples);
+        MakeMCAmericanEngine_2& withCalibrationSamples(Size samples);
+        MakeMCAmericanEngine_2& withPolynomialOrder(Size order);
+        MakeMCAmericanEngine_2& withSeed(BigNatural seed);
+        MakeMCAmericanEngine_2& withThreads(Size threads);
+        MakeMCAmericanEngine_2& withBlockSize(Size blockSize);
+        // conversion to pricing engine
+        operator boost::shared_ptr<PricingEngine>() const;
+      private:
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size steps_, stepsPerYear_;
+        bool brownianBridge_, antithetic_;
+        Size samples_, calibrationSamples_, polynomialOrder_;
+        BigNatural seed_;
+        Size threads_, blockSize_;
+    };
+
+
+    // inline definitions
+
+    inline LongstaffSchwartzRule::LongstaffSchwartzRule(
+                                  Option::Type type,
+                                  Real strike,
+                                  const std::vector<DiscountFactor>& discounts,
+                                  const std::vector<bool>& exercisable,
+                                  Size polynomialOrder)
+    : sign_(type == Option::Call ? 1.0 : -1.0), strike_(strike),
+      discounts_(discounts), exercisable_(exercisable),
+      basisSize_(polynomialOrder+1), coefficients_(discounts.size()),
+      calibrated_(false) {
+        QL_REQUIRE(strike > 0.0, "positive strike required");
+        QL_REQUIRE(discounts.size() == exercisable.size(),
+                   "discounts and exercise times differ in number");
+        QL_REQUIRE(discounts.size() > 1, "at least one time step required");
+    }
+
+    inline void LongstaffSchwartzRule::calibrate(const Real* paths,
+                                                 Size stride, Size n,
+                                                 Real* cashFlows) {
+        const Size last = discounts_.size()-1;
+        const Real* terminal = paths + last*stride;
+        for (Size j=0; j<n; ++j)
+            cashFlows[j] = payoff(terminal[j]);
+
+        const Size m = basisSize_;
+        Matrix A(m, m);
+        Array b(m), x(m);
+        for (Size i=last; i>0; --i) {
+            // cash flows are carried back to the i-th time
+            const Real df = discounts_[i]/discounts_[i-1];
+            for (Size j=0; j<n; ++j)
+                cashFlows[j] *= df;
+            if (i-1 == 0 || !exercisable_[i-1])
+                continue;
+
+            const Real* s = paths + (i-1)*stride;
+            std::fill(A.begin(), A.end(), 0.0);
+            std::fill(b.begin(), b.end(), 0.0);
+            Size inTheMoney = 0;
+            for (Size j=0; j<n; ++j) {
+                if (payoff(s[j]) <= 0.0)
+                    continue;
+                ++inTheMoney;
+                Real xj = s[j]/strike_;
+                x[0] = 1.0;
+                for (Size k=1; k<m; ++k)
+                    x[k] = x[k-1]*xj;
+                for (Size k=0; k<m; ++k) {
+                    for (Size l=k; l<m; ++l)
+                        A[k][l] += x[k]*x[l];
+                    b[k] += x[k]*cashFlows[j];
+                }
+            }
+            if (inTheMoney <= m)
+                continue;
+            for (Size k=0; k<m; ++k)
+                for (Size l=0; l<k; ++l)
+                    A[k][l] = A[l][k];
+            Array& c = coefficients_[i-1];
+            c = SVD(A).solveFor(b);
+
+            for (Size j=0; j<n; ++j) {
+                Real exercise = payoff(s[j]);
+                if (exercise > 0.0 && exercise > continuation(c, s[j]))
+                    cashFlows[j] = exercise;
+            }
+        }
+        calibrated_ = true;
+    }
+
+    template <class PathValues>
+    inline void LongstaffSchwartzRule::price(const PathValues& path,
+                                             Size n, Real* values,
+                                             Real* alive) const {
+        QL_REQUIRE(calibrated_, "exercise rule not calibrated");
+        const Size last = discounts_.size()-1;
+        std::fill(values, values+n, 0.0);
+        std::fill(alive, alive+n, 1.0);
+        for (Size i=1; i<last; ++i) {
+            const Array& c = coefficients_[i];
+            if (!exercisable_[i] || c.empty())
+                continue;
+            const Real* s = path(i);
+            const Real discount = discounts_[i];
+            for (Size j=0; j<n; ++j) {
+                Real exercise = payoff(s[j]);
+                bool exercised = alive[j] > 0.0 && exercise > 0.0 &&
+                                 exercise > continuation(c, s[j]);
+                values[j] += exercised ? discount*exercise : 0.0;
+                alive[j] = exercised ? 0.0 : alive[j];
+            }
+        }
+        const Real* terminal = path(last);
+        const Real discount = discounts_[last];
+        for (Size j=0; j<n; ++j)
+            values[j] += alive[j]*discount*payoff(terminal[j]);
+    }
+
+
+    template <class RNG, class S>
+    inline AmericanBlockModel_2<RNG,S>::AmericanBlockModel_2(
+                 const boost::shared_ptr<block_generator_type>& generator,
+                 const boost::shared_ptr<LongstaffSchwartzRule>& rule,
+                 bool antitheticVariate,
+                 MonteCarloArena* arena)
+    : generator_(generator), rule_(rule),
+      antitheticVariate_(antitheticVariate) {
+        if (!arena)
+            arena = &ownArena_;
+        values_ = arena->allocate(2*generator_->blockSize());
+        alive_ = arena->allocate(2*generator_->blockSize());
+    }
+
+    template <class RNG, class S>
+    inline void AmericanBlockModel_2<RNG,S>::addSamples(Size samples) {
+        sampleAccumulator_.reserve(sampleAccumulator_.samples() + samples);
+        detail::BlockPathValues<block_generator_type> path(*generator_);
+        while (samples > 0) {
+            Size n = std::min(samples, generator_->blockSize());
+            generator_->next(n, antitheticVariate_);
+            Size m = antitheticVariate_ ? 2*n : n;
+            rule_->price(path, m, values_, alive_);
+            if (antitheticVariate_) {
+                for (Size j=0; j<n; ++j)
+                    values_[j] = (values_[j] + values_[n+j])/2.0;
+            }
+            sampleAccumulator_.addSequence(values_, values_+n);
+            samples -= n;
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline MCAmericanEngine_2<RNG,S>::MCAmericanEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps,
+             Size timeStepsPerYear,
+             bool brownianBridge,
+             bool antitheticVariate,
+             Size requiredSamples,
+             Size calibrationSamples,
+             Size polynomialOrder,
+             BigNatural seed,
+             Size threads,
+             Size blockSize)
+    : process_(process), timeSteps_(timeSteps),
+      timeStepsPerYear_(timeStepsPerYear), brownianBridge_(brownianBridge),
+      antitheticVariate_(antitheticVariate),
+      requiredSamples_(requiredSamples),
+      calibrationSamples_(calibrationSamples),
+      polynomialOrder_(polynomialOrder), seed_(seed),
+      threads_(threads), blockSize_(blockSize) {
+        QL_REQUIRE(timeSteps != Null<Size>() ||
+                   timeStepsPerYear != Null<Size>(),
+                   "no time steps provided");
+        QL_REQUIRE(timeSteps == Null<Size>() ||
+                   timeStepsPerYear == Null<Size>(),
+                   "both time steps and time steps per year were provided");
+        QL_REQUIRE(requiredSamples != Null<Size>() && requiredSamples > 0,
+                   "number of samples not given");
+        QL_REQUIRE(calibrationSamples > polynomialOrder+1,
+                   "too few calibration samples given");
+        QL_REQUIRE(threads > 0, "at least one thread required");
+        QL_REQUIRE(threads == 1 ||
+                   RandomAccessTraits<RNG>::allowsRandomAccess,
+                   "multiple threads require a random-access policy");
+        QL_REQUIRE(blockSize > 0, "null block size given");
+        registerWith(process_);
+    }
+
+    template <class RNG, class S>
+    inline TimeGrid MCAmericanEngine_2<RNG,S>::timeGrid() const {
+        Date lastExerciseDate = this->arguments_.exercise->lastDate();
+        Time t = process_->time(lastExerciseDate);
+        if (timeSteps_ != Null<Size>())
+            return TimeGrid(t, timeSteps_);
+        Size steps = std::max<Size>(Size(timeStepsPerYear_*t), 1);
+        return TimeGrid(t, steps);
+    }
+
+    template <class RNG, class S>
+    inline void MCAmericanEngine_2<RNG,S>::calculate() const {
+        QL_REQUIRE(this->arguments_.exercise->type() == Exercise::American,
+                   "not an American option");
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        TimeGrid grid = timeGrid();
+        boost::shared_ptr<ConstantBlackScholesProcess> process =
+            makeConstantBlackScholesProcess(process_, grid.back(),
+                                            payoff->strike());
+        // separate streams for calibration and pricing
+        MersenneTwisterUniformRng seeder(seed_);
+        BigNatural calibrationSeed = seeder.nextInt32();
+        BigNatural pricingSeed = seeder.nextInt32();
+
+        arena_.reset();
+        boost::shared_ptr<LongstaffSchwartzRule> rule =
+            calibrate(process, grid, calibrationSeed);
+
+        std::vector<BigNatural> seeds, firstSequences;
+        threadStreams(pricingSeed, seeds, firstSequences, requiredSamples_);
+        std::vector<boost::shared_ptr<model_type> > workers(threads_);
+        for (Size i=0; i<threads_; ++i)
+            workers[i] = boost::shared_ptr<model_type>(
+                new model_type(blockGenerator(process, grid, seeds[i],
+                                              firstSequences[i]),
+                               rule, antitheticVariate_, &arena_));
+        runWorkers(workers, requiredSamples_);
+
+        S stats;
+        stats.reserve(requiredSamples_);
+        for (Size i=0; i<threads_; ++i)
+            detail::addStatistics(stats, workers[i]->sampleAccumulator());
+
+        Real value = stats.mean();
+        // exercise at the earliest date, if it is today
+        Date earliest = this->arguments_.exercise->dates()[0];
+        if (process_->time(earliest) <= 0.0)
+            value = std::max(value, rule->payoff(process->x0()));
+        this->results_.value = value;
+        if (RNG::allowsErrorEstimate)
+            this->results_.errorEstimate = stats.errorEstimate();
+    }
+
+    template <class RNG, class S>
+    inline boost::shared_ptr<LongstaffSchwartzRule>
+    MCAmericanEngine_2<RNG,S>::calibrate(
+             const boost::shared_ptr<ConstantBlackScholesProcess>& process,
+             const TimeGrid& grid,
+             BigNatural seed) const {
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        Time earliest = process_->time(this->arguments_.exercise->dates()[0]);
+        std::vector<DiscountFactor> discounts(grid.size());
+        std::vector<bool> exercisable(grid.size());
+        for (Size i=0; i<grid.size(); ++i) {
+            discounts[i] = std::exp(-process->riskFreeRate()*grid[i]);
+            exercisable[i] = (grid[i] >= earliest);
+        }
+        boost::shared_ptr<LongstaffSchwartzRule> rule(
+            new LongstaffSchwartzRule(payoff->optionType(), payoff->strike(),
+                                      discounts, exercisable,
+                                      polynomialOrder_));
+
+        // one array per time, each holding the values of all the paths
+        const Size n = calibrationSamples_;
+        Real* paths = arena_.allocate(grid.size()*n);
+        Real* cashFlows = arena_.allocate(n);
+        std::vector<BigNatural> seeds, firstSequences;
+        threadStreams(seed, seeds, firstSequences, n);
+        typedef detail::AmericanPathFiller<typename RNG::rsg_type> filler;
+        std::vector<boost::shared_ptr<filler> > fillers(threads_);
+        Size first = 0;
+        for (Size i=0; i<threads_; ++i) {
+            fillers[i] = boost::shared_ptr<filler>(
+                new filler(blockGenerator(process, grid, seeds[i],
+                                          firstSequences[i]),
+                           paths, n, first));
+            first += detail::batchShare(n, threads_, i);
+        }
+        runWorkers(fillers, n);
+
+        rule->calibrate(paths, n, n, cashFlows);
+        return rule;
+    }
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCAmericanEngine_2<RNG,S>::block_generator_type>
+    MCAmericanEngine_2<RNG,S>::blockGenerator(
+             const boost::shared_ptr<ConstantBlackScholesProcess>& process,
+             const TimeGrid& grid,
+             BigNatural seed, BigNatural firstSequence) const {
+        typename RNG::rsg_type generator =
+            RandomAccessTraits<RNG>::make_sequence_generator(grid.size()-1,
+                                                             seed,
+                                                             firstSequence);
+        return boost::shared_ptr<block_generator_type>(
+            new block_generator_type(process, grid, generator,
+                                     brownianBridge_, blockSize_, &arena_));
+    }
+
+    template <class RNG, class S>
+    inline void MCAmericanEngine_2<RNG,S>::threadStreams(
+                               BigNatural seed,
+                               std::vector<BigNatural>& seeds,
+                               std::vector<BigNatural>& firstSequences,
+                               Size samples) const {
+        // one stream, split among the threads
+        seeds.assign(threads_, seed);
+        firstSequences.resize(threads_);
+        Size first = 0;
+        for (Size i=0; i<threads_; ++i) {
+            firstSequences[i] = first;
+            first += detail::batchShare(samples, threads_, i);
+        }
+    }
+
+    template <class RNG, class S>
+    template <class Model>
+    inline void MCAmericanEngine_2<RNG,S>::runWorkers(
+                      const std::vector<boost::shared_ptr<Model> >& workers,
+                      Size samples) const {
+        Size n = workers.size();
+        if (n == 1) {
+            workers[0]->addSamples(samples);
+            return;
+        }
+        std::vector<std::string> errors(n);
+        boost::thread_group threads;
+        for (Size i=0; i<n; ++i) {
+            threads.create_thread(
+                detail::McWorkerTask<Model>(
+                    workers[i], detail::batchShare(samples, n, i),
+                    errors[i]));
+        }
+        threads.join_all();
+        for (Size i=0; i<n; ++i)
+            QL_REQUIRE(errors[i].empty(), errors[i]);
+    }
+
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>::MakeMCAmericanEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process)
+    : process_(process), steps_(Null<Size>()), stepsPerYear_(Null<Size>()),
+      brownianBridge_(false), antithetic_(false), samples_(Null<Size>()),
+      calibrationSamples_(2048), polynomialOrder_(2), seed_(0),
+      threads_(1), blockSize_(4096) {}
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withSteps(Size steps) {
+        steps_ = steps;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withStepsPerYear(Size steps) {
+        stepsPerYear_ = steps;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withBrownianBridge(bool b) {
+        brownianBridge_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withAntitheticVariate(bool b) {
+        antithetic_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withSamples(Size samples) {
+        samples_ = samples;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withCalibrationSamples(Size samples) {
+        calibrationSamples_ = samples;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withPolynomialOrder(Size order) {
+        polynomialOrder_ = order;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withSeed(BigNatural seed) {
+        seed_ = seed;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withThreads(Size threads) {
+        threads_ = threads;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withBlockSize(Size blockSize) {
+        blockSize_ = blockSize;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline
+    MakeMCAmericanEngine_2<RNG,S>::operator boost::shared_ptr<PricingEngine>()
+                                                                      const {
+        QL_REQUIRE(steps_ != Null<Size>() || stepsPerYear_ != Null<Size>(),
+                   "number of steps not given");
+        QL_REQUIRE(steps_ == Null<Size>() || stepsPerYear_ == Null<Size>(),
+                   "number of steps overspecified");
+        return boost::shared_ptr<PricingEngine>(new
+            MCAmericanEngine_2<RNG,S>(process_,
+                                      steps_,
+                                      stepsPerYear_,
+                                      brownianBridge_,
+                                      antithetic_,
+                                      samples_,
+                                      calibrationSamples_,
+                                      polynomialOrder_,
+                                      seed_,
+                                      threads_,
+                                      blockSize_));
+    }
+
+}
+
+
+#endif
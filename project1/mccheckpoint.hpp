@@ -0,0 +1,261 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file mccheckpoint.hpp
+    \brief State of an interrupted Monte Carlo simulation
+*/
+
+#ifndef montecarlo_checkpoint_hpp
+#define montecarlo_checkpoint_hpp
+
+#include <ql/types.hpp>
+#include <ql/errors.hpp>
+#include <boost/cstdint.hpp>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace QuantLib {
+
+    //! State of a Monte Carlo simulation, saved to resume it later
+    /*! The state consists of the number of samples simulated, of the
+        samples still to be simulated in the current batch, of the
+        number of sequences drawn from each generator stream and of
+        the samples accumulated by the statistics. It is valid only
+        for the seed, the random-number policy and the configuration
+        it was saved with; the policy is identified by a name and the
+        configuration is given as a vector of parameters by the
+        caller. load() rejects files saved with different ones.
+
+        The file contains the raw values and weights of the samples,
+        so that the statistics are restored exactly; it is written in
+        the native byte order and is not meant to be moved across
+        platforms. After a header holding the configuration, each
+        save appends a record with the current counters and the
+        samples added since the previous save, so that the cost of a
+        save doesn't grow with the samples already saved. A run
+        killed while saving leaves an incomplete last record, which
+        load() ignores; a resumed run rewrites the file, atomically,
+        as a single record before appending to it.
+
+        The statistics class must store its samples as
+        GeneralStatistics does.
+
+        \ingroup mcarlo
+    */
+    class McCheckpoint {
+      public:
+        McCheckpoint() : seed(0), sampleNumber(0), pendingSamples(0) {}
+        //! \name Configuration
+        //@{
+        BigNatural seed;
+        std::string policy;
+        std::vector<Real> configuration;
+        //@}
+        //! \name State
+        //@{
+        Size sampleNumber, pendingSamples;
+        std::vector<Size> sequences;
+        //@}
+        //! appends the samples added since the last save or load
+        template <class S>
+        void save(const std::string& file,
+                  const std::vector<const S*>& statistics);
+        //! false if the file is missing, damaged or for another configuration
+        template <class S>
+        bool load(const std::string& file,
+                  const std::vector<S*>& statistics);
+      private:
+        enum { magic = 0x4D434350, version = 3, recordMark = 0x52454344 };
+        typedef boost::uint64_t count_type;
+        static void write(std::ofstream& out, count_type n) {
+            out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        }
+        static bool read(std::ifstream& in, count_type& n) {
+            in.read(reinterpret_cast<char*>(&n), sizeof(n));
+            return bool(in);
+        }
+        template <class S>
+        void writeRecord(std::ofstream& out,
+                         const std::vector<const S*>& statistics) const;
+        template <class S>
+        void rewrite(const std::string& file,
+                     const std::vector<const S*>& statistics);
+        // samples of each statistics already in the file
+        std::vector<Size> saved_;
+    };
+
+
+    // inline definitions
+
+    template <class S>
+    void McCheckpoint::writeRecord(
+                          std::ofstream& out,
+                          const std::vector<const S*>& statistics) const {
+        write(out, recordMark);
+        write(out, sampleNumber);
+        write(out, pendingSamples);
+        write(out, sequences.size());
+        for (Size i=0; i<sequences.size(); ++i)
+            write(out, sequences[i]);
+        for (Size i=0; i<statistics.size(); ++i) {
+            const std::vector<std::pair<Real,Real> >& data =
+                statistics[i]->data();
+            write(out, data.size() - saved_[i]);
+            for (Size j=saved_[i]; j<data.size(); ++j) {
+                out.write(reinterpret_cast<const char*>(&data[j].first),
+                          sizeof(Real));
+                out.write(reinterpret_cast<const char*>(&data[j].second),
+                          sizeof(Real));
+            }
+        }
+        // a record is complete only if its closing mark was written
+        write(out, recordMark);
+    }
+
+    template <class S>
+    void McCheckpoint::rewrite(const std::string& file,
+                               const std::vector<const S*>& statistics) {
+        saved_.assign(statistics.size(), 0);
+        std::string temporary = file + ".tmp";
+        {
+            std::ofstream out(temporary.c_str(),
+                              std::ios::out | std::ios::binary);
+            QL_REQUIRE(out, "cannot open checkpoint file " << temporary);
+            write(out, magic);
+            write(out, version);
+            write(out, seed);
+            write(out, policy.size());
+            out.write(policy.data(), policy.size());
+            write(out, configuration.size());
+            if (!configuration.empty())
+                out.write(reinterpret_cast<const char*>(&configuration[0]),
+                          configuration.size()*sizeof(Real));
+            write(out, statistics.size());
+            writeRecord(out, statistics);
+            QL_REQUIRE(out, "cannot write checkpoint file " << temporary);
+        }
+        std::remove(file.c_str());
+        QL_REQUIRE(std::rename(temporary.c_str(), file.c_str()) == 0,
+                   "cannot replace checkpoint file " << file);
+        for (Size i=0; i<statistics.size(); ++i)
+            saved_[i] = statistics[i]->data().size();
+    }
+
+    template <class S>
+    void McCheckpoint::save(const std::string& file,
+                            const std::vector<const S*>& statistics) {
+        if (saved_.size() != statistics.size()) {
+            // first save of this run
+            rewrite(file, statistics);
+            return;
+        }
+        {
+            std::ofstream out(file.c_str(), std::ios::out |
+                                            std::ios::binary |
+                                            std::ios::app);
+            QL_REQUIRE(out, "cannot open checkpoint file " << file);
+            writeRecord(out, statistics);
+            out.flush();
+            QL_REQUIRE(out, "cannot write checkpoint file " << file);
+        }
+        for (Size i=0; i<statistics.size(); ++i)
+            saved_[i] = statistics[i]->data().size();
+    }
+
+    template <class S>
+    bool McCheckpoint::load(const std::string& file,
+                            const std::vector<S*>& statistics) {
+        std::vector<std::vector<std::pair<Real,Real> > >
+                                                  data(statistics.size());
+        count_type samples = 0, pending = 0, n, m;
+        std::vector<Size> drawn;
+        bool found = false;
+        {
+            std::ifstream in(file.c_str(), std::ios::in | std::ios::binary);
+            if (!in)
+                return false;
+            if (!read(in, n) || n != count_type(magic) ||
+                !read(in, n) || n != count_type(version) ||
+                !read(in, n) || n != count_type(seed) ||
+                !read(in, n) || n != policy.size())
+                return false;
+            std::string savedPolicy(policy.size(), ' ');
+            if (!savedPolicy.empty())
+                in.read(&savedPolicy[0], savedPolicy.size());
+            if (!in || savedPolicy != policy ||
+                !read(in, n) || n != configuration.size())
+                return false;
+            std::vector<Real> savedConfiguration(configuration.size());
+            if (!savedConfiguration.empty())
+                in.read(reinterpret_cast<char*>(&savedConfiguration[0]),
+                        savedConfiguration.size()*sizeof(Real));
+            if (!in || savedConfiguration != configuration ||
+                !read(in, n) || n != statistics.size())
+                return false;
+            // complete records only; nothing is modified until the end
+            for (;;) {
+                count_type recordSamples, recordPending;
+                if (!read(in, n) || n != count_type(recordMark) ||
+                    !read(in, recordSamples) || !read(in, recordPending) ||
+                    !read(in, n))
+                    break;
+                std::vector<Size> recordDrawn(n);
+                bool complete = true;
+                for (Size i=0; i<recordDrawn.size() && complete; ++i) {
+                    complete = read(in, m);
+                    recordDrawn[i] = Size(m);
+                }
+                std::vector<Size> sizes(data.size());
+                for (Size i=0; i<data.size(); ++i)
+                    sizes[i] = data[i].size();
+                for (Size i=0; i<data.size() && complete; ++i) {
+                    complete = read(in, m);
+                    if (!complete)
+                        break;
+                    data[i].resize(sizes[i] + m);
+                    for (Size j=sizes[i]; j<data[i].size(); ++j) {
+                        in.read(reinterpret_cast<char*>(&data[i][j].first),
+                                sizeof(Real));
+                        in.read(reinterpret_cast<char*>(&data[i][j].second),
+                                sizeof(Real));
+                    }
+                    complete = bool(in);
+                }
+                complete = complete && read(in, n) &&
+                           n == count_type(recordMark);
+                if (!complete) {
+                    // drop the samples of the incomplete record
+                    for (Size i=0; i<data.size(); ++i)
+                        data[i].resize(sizes[i]);
+                    break;
+                }
+                samples = recordSamples;
+                pending = recordPending;
+                drawn.swap(recordDrawn);
+                found = true;
+            }
+        }
+        if (!found)
+            return false;
+
+        sampleNumber = Size(samples);
+        pendingSamples = Size(pending);
+        sequences.swap(drawn);
+        for (Size i=0; i<data.size(); ++i) {
+            statistics[i]->reset();
+            statistics[i]->reserve(data[i].size());
+            for (Size j=0; j<data[i].size(); ++j)
+                statistics[i]->add(data[i][j].first, data[i][j].second);
+        }
+        // later saves append to a file holding exactly this state
+        rewrite(file, std::vector<const S*>(statistics.begin(),
+                                            statistics.end()));
+        return true;
+    }
+
+}
+
+
+#endif
@@ -26,13 +26,135 @@
 #ifndef montecarlo_european_engine_hpp
 #define montecarlo_european_engine_hpp
 
+#include "constantblackscholesprocess.hpp"
+#include "counterbasedrng.hpp"
+#include "scrambledsobolrsg.hpp"
+#include "blockpathgenerator.hpp"
+#include "normaldrawcache.hpp"
+#include "mccheckpoint.hpp"
+#include "quantilesketch.hpp"
+#include "europeanterminalkernel.hpp"
 #include <ql/pricingengines/vanilla/mcvanillaengine.hpp>
 #include <ql/processes/blackscholesprocess.hpp>
 #include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
 #include <ql/termstructures/volatility/equityfx/blackvariancecurve.hpp>
+#include <ql/math/randomnumbers/mt19937uniformrng.hpp>
+#include <ql/math/distributions/normaldistribution.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <typeinfo>
 
 namespace QuantLib {
 
+    namespace detail {
+
+        //! runs a batch of samples on one of the engine threads
+        /*! Exceptions cannot cross thread boundaries; their message is
+            stored and rethrown by the calling thread after joining.
+        */
+        template <class Model>
+        class McWorkerTask {
+          public:
+            McWorkerTask(const boost::shared_ptr<Model>& model,
+                         Size samples,
+                         std::string& error)
+            : model_(model), samples_(samples), error_(error) {}
+            void operator()() const {
+                try {
+                    model_->addSamples(samples_);
+                } catch (std::exception& e) {
+                    error_ = e.what();
+                } catch (...) {
+                    error_ = "unknown error";
+                }
+            }
+          private:
+            boost::shared_ptr<Model> model_;
+            Size samples_;
+            std::string& error_;
+        };
+
+        //! number of samples of a batch assigned to the i-th of n threads
+        inline Size batchShare(Size samples, Size n, Size i) {
+            return samples/n + (i < samples%n ? 1 : 0);
+        }
+
+        //! appends the samples of one accumulator to another
+        /*! S must store its samples as GeneralStatistics does. */
+        template <class S>
+        inline void addStatistics(S& to, const S& from, Size first = 0) {
+            const std::vector<std::pair<Real,Real> >& data = from.data();
+            for (Size i=first; i<data.size(); ++i)
+                to.add(data[i].first, data[i].second);
+        }
+
+        //! importance-sampling shift of the terminal Gaussian variate
+        /*! The mean is moved to the variate at which the option goes
+            in the money, if the latter is out of the money at the
+            median; otherwise, no shift is applied.
+        */
+        inline Real europeanImportanceShift(
+                                  Option::Type type, Real strike,
+                                  const ConstantBlackScholesProcess& process,
+                                  Time maturity) {
+            if (strike <= 0.0)
+                return 0.0;
+            Real stdDev = process.stdDeviation(0.0, process.x0(), maturity);
+            Real d = (std::log(strike/process.x0())
+                      - process.drift(0.0, process.x0())*maturity) / stdDev;
+            return type == Option::Call ? std::max(d, 0.0)
+                                        : std::min(d, 0.0);
+        }
+
+        //! variance of the discounted payoff under the original measure
+        inline Real europeanPayoffVariance(
+                                  Option::Type type, Real strike,
+                                  DiscountFactor discount,
+                                  const ConstantBlackScholesProcess& process,
+                                  Time maturity) {
+            // ln S_T ~ N(a, v^2); E[S^k; S>K] = e^{ka+k^2v^2/2} N(d_k)
+            Real v = process.stdDeviation(0.0, process.x0(), maturity);
+            Real a = std::log(process.x0())
+                   + process.drift(0.0, process.x0())*maturity;
+            CumulativeNormalDistribution N;
+            Real sign = (type == Option::Call ? 1.0 : -1.0);
+            Real logK = std::log(std::max(strike, QL_EPSILON));
+            Real m[3];
+            for (Size k=0; k<3; ++k) {
+                Real d = (a + k*v*v - logK)/v;
+                m[k] = std::exp(k*a + 0.5*k*k*v*v) * N(sign*d);
+            }
+            Real first = sign*(m[1] - strike*m[0]);
+            Real second = m[2] - 2.0*strike*m[1] + strike*strike*m[0];
+            return discount*discount*(second - first*first);
+        }
+
+    }
+
+    template <class RNG, class S> class EuropeanBlockModel_2;
+    class EuropeanPathPricer_2;
+    class EuropeanGreeksPathPricer_2;
+
+    //! control variates available to MCEuropeanEngine_2
+    /*! The control is evaluated on the simulated paths and has a
+        closed-form expectation: the discounted forward of the
+        underlying (i.e., the value of a zero-strike call). It is
+        applied with the coefficient minimizing the variance, i.e.,
+        the covariance of the option and control samples divided by
+        the variance of the latter, as estimated on a pilot run; with
+        a unit coefficient, the control would increase the variance of
+        puts and of out-of-the-money calls.
+
+        The Black-Scholes price of the option itself is not offered
+        as a control: since the paths are drawn from the
+        constant-coefficient snapshot of the process, it is the exact
+        expectation of the simulated payoff, and the estimator would
+        return it without any simulation.
+    */
+    struct EuropeanControlVariate {
+        enum Type { None, DiscountedForward };
+    };
+
     //! European option pricing engine using Monte Carlo simulation
     /*! \ingroup vanillaengines
 
@@ -60,9 +182,287 @@ namespace QuantLib {
              Size requiredSamples,
              Real requiredTolerance,
              Size maxSamples,
-             BigNatural seed);
+             BigNatural seed,
+             bool terminalSampling = false,
+             Size threads = 1,
+             Size blockSize = 0,
+             EuropeanControlVariate::Type controlVariate =
+                                              EuropeanControlVariate::None,
+             bool greeks = false,
+             Size randomizations = 16,
+             bool importanceSampling = false,
+             BlockSampling::Type terminalVariateSampling =
+                                                  BlockSampling::Independent,
+             Size samplingGroupSize = 1,
+             bool incrementalRepricing = false,
+             bool commonRandomNumbers = false,
+             const std::string& checkpointFile = "",
+             Size checkpointInterval = 1000000,
+             const std::vector<Real>& quantileLevels = std::vector<Real>(),
+             Real sketchCompression = 200.0,
+             Size pilotSamples = Null<Size>(),
+             bool singlePrecision = false);
+        /*! when more than one thread is required, the samples are
+            split among the threads, each of which accumulates its own
+            statistics; the latter are merged in thread order. The
+            threads do not own a stream: each part of a batch is drawn
+            from the engine seed starting at its global sample index,
+            so that the results do not depend on the number of
+            threads. This requires a random-number policy allowing
+            random access (see RandomAccessTraits) such as
+            CounterBasedRandom; generators seeded independently for
+            each thread would not be guaranteed not to overlap.
+
+            If a block size is given, paths are simulated in blocks
+            of that size by a BlockPathGenerator and the payoff is
+            evaluated on a whole block at once; this also applies to
+            each thread. Only in this mode, buffers are carved from an
+            arena kept across calculations and the sample loop makes
+            no heap allocation; the per-path mode still allocates a
+            Path for each sample.
+
+            If a control variate is used, its coefficient is estimated
+            before each calculation on a pilot run of 4096 samples,
+            simulated in blocks with the same sampling options as the
+            calculation but drawn from a different seed, so that it is
+            independent of the samples used for the value. The
+            coefficient is returned as the "controlVariateCoefficient"
+            additional result.
+
+            If Greeks are required, delta, gamma and vega are
+            estimated on the same paths as the value (see
+            EuropeanGreeksPathPricer_2) and their error estimates are
+            returned as the "deltaErrorEstimate", "gammaErrorEstimate"
+            and "vegaErrorEstimate" additional results. Greeks are
+            only available in block simulation; if no block size was
+            given, blocks of 4096 paths are used.
+
+            With a randomized quasi-random policy (see
+            RandomizationTraits) the given number of independent
+            randomizations is run, in parallel if more threads are
+            available, each with the same number of points. The value
+            is their average and the error is estimated from their
+            spread; when a tolerance is given, the number of points is
+            doubled until the latter is met. The number of samples
+            counts the points of all randomizations, while the sample
+            accumulator holds the estimate of each randomization.
+
+            If importance sampling is enabled, the terminal Gaussian
+            variate of out-of-the-money options is drawn with its mean
+            shifted to the money (see detail::europeanImportanceShift)
+            and samples are weighted by their likelihood ratio. The
+            shift is returned as the "importanceSamplingShift"
+            additional result, and the ratio between the variance of
+            plain Monte Carlo samples and that of the samples actually
+            used as "varianceReduction"; with randomized sequences,
+            the latter variance is the one that would give the
+            achieved error with as many independent samples. Like
+            Greeks, importance sampling uses block simulation.
+
+            The terminal variate can also be drawn by stratified
+            sampling or moment matching over groups of paths (see
+            BlockSampling); each group then counts as one sample of
+            the statistics. These schemes use block simulation too;
+            since groups follow the block boundaries, the results
+            depend on how samples are split between threads.
+
+            In incremental mode, the terminal values of the simulated
+            paths, divided by the spot, are kept after the calculation.
+            If the next calculation has the same risk-free rate,
+            dividend yield, volatility and maturity, the option is
+            repriced on those samples rescaled to the new spot, without
+            a new simulation; this is exact under the Black-Scholes
+            dynamics. The samples are simulated again if any of the
+            above changed or if the error is above the required
+            tolerance after rescaling. The stored samples take one or
+            two Reals per sample, depending on antithetic variates.
+            Incremental mode uses block simulation and is not available
+            with importance sampling, grouped sampling or randomized
+            quasi-random sequences.
+
+            With common random numbers, the Gaussian draws of each
+            generator stream are kept in NormalDrawCache, whose memory
+            cap can be set by the user; a later calculation with the
+            same seed, random-number policy and number of time steps
+            reads them from the cache instead of generating them again,
+            so that bumped calculations (e.g., finite-difference Greeks)
+            share their draws and only pay for the path construction.
+            A calculation requiring more samples than are cached draws
+            the rest and extends the cache. Common random numbers use
+            block simulation and require a non-null seed.
+
+            If a checkpoint file is given, the state of the simulation
+            (see McCheckpoint) is saved to it whenever the given number
+            of samples has been added, and the file is removed when the
+            calculation is complete. A calculation finding a checkpoint
+            saved with the same parameters and market data resumes from
+            it; the results are the same, bit by bit, as those of an
+            uninterrupted calculation. Generators that don't allow
+            random access are brought back to their position by drawing
+            again the sequences before it. Checkpoints require a non-null
+            seed; they are not available in incremental mode or with
+            randomized sequences, and the statistics class must store
+            its samples.
+
+            If quantile levels are given, the discounted payoffs of all
+            simulated paths, weighted by their likelihood ratio under
+            importance sampling, are fed to a QuantileSketch on each
+            thread; the sketches are merged at the end of each batch.
+            The payoff quantiles at the given levels are returned as the
+            "payoffQuantiles" additional result and the mean payoffs
+            beyond them (see QuantileSketch::tailMean) as
+            "expectedShortfall", both as vectors. Quantiles use block
+            simulation and are not available with checkpoints.
+
+            When a tolerance is required and a number of pilot samples
+            is given, the variance is estimated on a pilot batch of that
+            size; the number of samples needed for the tolerance, plus a
+            10% margin against the uncertainty of the estimate, is then
+            run as a single batch split among the threads, instead of
+            the small increments of the default schedule. Further
+            batches are planned in the same way if the error is still
+            above the tolerance. The total of the first plan is returned
+            as the "plannedSamples" additional result, the error it was
+            expected to reach as "predictedErrorEstimate" (the achieved
+            one being the error estimate of the results) and the elapsed
+            wall-clock time, in seconds, as "wallTime". The planner is
+            not used with randomized sequences.
+
+            In single precision, terminal samples are drawn and priced
+            in float by EuropeanTerminalKernel, from its own Philox
+            stream of the engine seed, a block at a time; payoffs are
+            widened to double before reaching the statistics. It
+            requires terminal sampling and no control variate, Greeks,
+            importance sampling, grouped sampling, incremental mode,
+            common random numbers, quantiles or randomized sequences.
+        */
+        void calculate() const;
       protected:
+        typedef MonteCarloModel<SingleVariate,RNG,S> model_type;
+        typedef EuropeanBlockModel_2<RNG,S> block_model_type;
+        typedef EuropeanTerminalModel_2<float,S> float_model_type;
         boost::shared_ptr<path_pricer_type> pathPricer() const;
+        boost::shared_ptr<EuropeanPathPricer_2> europeanPathPricer() const;
+        boost::shared_ptr<path_pricer_type> controlPathPricer() const;
+        boost::shared_ptr<EuropeanPathPricer_2>
+        europeanControlPathPricer() const;
+        Real controlVariateValue() const;
+        /*! paths are generated from a constant-coefficient snapshot
+            of the process at maturity; this gives the same terminal
+            distribution without term-structure lookups at each step.
+        */
+        boost::shared_ptr<path_generator_type> pathGenerator() const;
+        boost::shared_ptr<path_generator_type>
+        pathGenerator(BigNatural seed, BigNatural firstSequence = 0) const;
+        /*! in terminal-sampling mode, the grid has a single step to
+            maturity and each path is drawn with one exact log-normal
+            step; the intermediate points are never generated.
+        */
+        TimeGrid timeGrid() const;
+        boost::shared_ptr<ConstantBlackScholesProcess>
+        constantProcess() const;
+        //! estimates the control-variate coefficient on a pilot run
+        void estimateControlCoefficient() const;
+        bool terminalSampling_;
+        Size threads_, blockSize_;
+        EuropeanControlVariate::Type controlVariateType_;
+        bool greeks_;
+        Size randomizations_;
+        bool importanceSampling_;
+        BlockSampling::Type terminalVariateSampling_;
+        Size samplingGroupSize_;
+        bool incrementalRepricing_;
+        bool commonRandomNumbers_;
+        std::string checkpointFile_;
+        Size checkpointInterval_;
+        std::vector<Real> quantileLevels_;
+        Real sketchCompression_;
+        Size pilotSamples_;
+        bool singlePrecision_;
+        //! control-variate coefficient of the current calculation
+        mutable Real controlCoefficient_;
+        //! storage for the block buffers, reused across calculations
+        mutable MonteCarloArena arena_;
+        //! \name Incremental-mode data
+        //@{
+        mutable std::vector<Real> terminalValues_;
+        mutable Rate cachedRiskFreeRate_, cachedDividendYield_;
+        mutable Volatility cachedVolatility_;
+        mutable Time cachedMaturity_;
+        //@}
+      private:
+        template <class Model>
+        void simulate() const;
+        template <class Model>
+        void simulateRandomized() const;
+        template <class Model>
+        void addSamples(const std::vector<boost::shared_ptr<Model> >& workers,
+                        Size samples) const;
+        template <class Model>
+        void runWorkers(const std::vector<boost::shared_ptr<Model> >& workers,
+                        const std::vector<Size>& samples) const;
+        boost::shared_ptr<model_type> newModel(
+               BigNatural seed, BigNatural firstSequence,
+               const boost::shared_ptr<EuropeanPathPricer_2>& pricer,
+               const boost::shared_ptr<EuropeanPathPricer_2>& controlPricer,
+               Real controlValue,
+               model_type*) const;
+        boost::shared_ptr<block_model_type> newModel(
+               BigNatural seed, BigNatural firstSequence,
+               const boost::shared_ptr<EuropeanPathPricer_2>& pricer,
+               const boost::shared_ptr<EuropeanPathPricer_2>& controlPricer,
+               Real controlValue,
+               block_model_type*) const;
+        //! a pilot model neither caches its draws nor prices Greeks
+        boost::shared_ptr<block_model_type> newBlockModel(
+               BigNatural seed, BigNatural firstSequence,
+               const boost::shared_ptr<EuropeanPathPricer_2>& pricer,
+               const boost::shared_ptr<EuropeanPathPricer_2>& controlPricer,
+               Real controlValue,
+               bool pilot) const;
+        boost::shared_ptr<float_model_type> newModel(
+               BigNatural seed, BigNatural firstSequence,
+               const boost::shared_ptr<EuropeanPathPricer_2>& pricer,
+               const boost::shared_ptr<EuropeanPathPricer_2>& controlPricer,
+               Real controlValue,
+               float_model_type*) const;
+        void addGreeks(S& delta, S& gamma, S& vega,
+                       const model_type&, Size first) const {}
+        void addGreeks(S& delta, S& gamma, S& vega,
+                       const float_model_type&, Size first) const {}
+        void addGreeks(S& delta, S& gamma, S& vega,
+                       const block_model_type&, Size first) const;
+        void addGreekMeans(S& delta, S& gamma, S& vega,
+                           const model_type&) const {}
+        void addGreekMeans(S& delta, S& gamma, S& vega,
+                           const block_model_type&) const;
+        void addSketch(QuantileSketch&, const model_type&) const {}
+        void addSketch(QuantileSketch&, const float_model_type&) const {}
+        void addSketch(QuantileSketch& sketch, block_model_type&) const;
+        std::vector<Real> checkpointConfiguration() const;
+        void setResults(
+               const S& stats, const S& deltas, const S& gammas,
+               const S& vegas,
+               const boost::shared_ptr<EuropeanPathPricer_2>& pricer,
+               const boost::shared_ptr<EuropeanPathPricer_2>& controlPricer,
+               Real controlValue) const;
+        //! variance is the variance of the estimate times the paths
+        void setImportanceSamplingResults(
+               const boost::shared_ptr<EuropeanPathPricer_2>& pricer,
+               Real variance) const;
+        void setQuantileResults(const QuantileSketch& sketch) const;
+        void calculateIncrementally() const;
+        void repriceFromTerminalValues() const;
+        void addTerminalValueRecord(model_type&) const {}
+        void addTerminalValueRecord(float_model_type&) const {}
+        void addTerminalValueRecord(block_model_type&) const;
+        Size effectiveBlockSize() const;
+        bool blockSimulation() const {
+            return blockSize_ != 0 || greeks_ || importanceSampling_ ||
+                terminalVariateSampling_ != BlockSampling::Independent ||
+                incrementalRepricing_ || commonRandomNumbers_ ||
+                !quantileLevels_.empty();
+        }
     };
 
     //! Monte Carlo European engine factory
@@ -80,6 +480,25 @@ namespace QuantLib {
         MakeMCEuropeanEngine_2& withMaxSamples(Size samples);
         MakeMCEuropeanEngine_2& withSeed(BigNatural seed);
         MakeMCEuropeanEngine_2& withAntitheticVariate(bool b = true);
+        MakeMCEuropeanEngine_2& withTerminalSampling(bool b = true);
+        MakeMCEuropeanEngine_2& withThreads(Size threads);
+        MakeMCEuropeanEngine_2& withBlockSimulation(Size blockSize = 4096);
+        MakeMCEuropeanEngine_2& withControlVariate(
+                                 EuropeanControlVariate::Type c =
+                                    EuropeanControlVariate::DiscountedForward);
+        MakeMCEuropeanEngine_2& withGreeks(bool b = true);
+        MakeMCEuropeanEngine_2& withRandomizations(Size randomizations);
+        MakeMCEuropeanEngine_2& withImportanceSampling(bool b = true);
+        MakeMCEuropeanEngine_2& withStratifiedSampling(Size strata = 16);
+        MakeMCEuropeanEngine_2& withMomentMatching(Size groupSize = 64);
+        MakeMCEuropeanEngine_2& withIncrementalRepricing(bool b = true);
+        MakeMCEuropeanEngine_2& withCommonRandomNumbers(bool b = true);
+        MakeMCEuropeanEngine_2& withCheckpoint(const std::string& file,
+                                               Size interval = 1000000);
+        MakeMCEuropeanEngine_2& withQuantiles(const std::vector<Real>& levels,
+                                              Real compression = 200.0);
+        MakeMCEuropeanEngine_2& withPilotRun(Size samples = 10000);
+        MakeMCEuropeanEngine_2& withSinglePrecision(bool b = true);
         // conversion to pricing engine
         operator boost::shared_ptr<PricingEngine>() const;
       private:
@@ -89,6 +508,22 @@ namespace QuantLib {
         Real tolerance_;
         bool brownianBridge_;
         BigNatural seed_;
+        bool terminalSampling_;
+        Size threads_, blockSize_;
+        EuropeanControlVariate::Type controlVariate_;
+        bool greeks_;
+        Size randomizations_;
+        bool importanceSampling_;
+        BlockSampling::Type terminalVariateSampling_;
+        Size samplingGroupSize_;
+        bool incrementalRepricing_;
+        bool commonRandomNumbers_;
+        std::string checkpointFile_;
+        Size checkpointInterval_;
+        std::vector<Real> quantileLevels_;
+        Real sketchCompression_;
+        Size pilotSamples_;
+        bool singlePrecision_;
     };
 
     class EuropeanPathPricer_2 : public PathPricer<Path> {
@@ -97,12 +532,145 @@ namespace QuantLib {
                              Real strike,
                              DiscountFactor discount);
         Real operator()(const Path& path) const;
+        //! discounted payoffs of n terminal values, in a single loop
+        void operator()(const Real* underlyings, Real* values,
+                        Size n) const;
+        DiscountFactor discount() const { return discount_; }
       private:
         PlainVanillaPayoff payoff_;
         DiscountFactor discount_;
     };
 
 
+    //! pathwise and likelihood-ratio Greeks of a European option
+    /*! Delta and vega are the pathwise derivatives of the discounted
+        payoff with respect to the spot and the volatility. Gamma uses
+        the mixed estimator
+        \f[ f'(S_T) \frac{S_T}{S_0^2}
+             \left( \frac{W_T}{\sigma T} - 1 \right), \f]
+        i.e., the likelihood-ratio derivative of the pathwise delta;
+        the payoff kink makes a second pathwise derivative useless.
+        See P. Glasserman, "Monte Carlo Methods in Financial
+        Engineering", section 7.3.
+
+        The paths are drawn from a constant-coefficient process, so
+        that the Brownian motion W_T can be recovered exactly from the
+        terminal value S_T.
+    */
+    class EuropeanGreeksPathPricer_2 {
+      public:
+        EuropeanGreeksPathPricer_2(Option::Type type,
+                                   Real strike,
+                                   DiscountFactor discount,
+                                   const ConstantBlackScholesProcess& process,
+                                   Time maturity);
+        //! per-path delta, gamma and vega of n terminal values
+        void operator()(const Real* underlyings,
+                        Real* deltas, Real* gammas, Real* vegas,
+                        Size n) const;
+      private:
+        Real sign_, strike_;
+        DiscountFactor discount_;
+        Real x0_, sigma_, maturity_, logDrift_;
+    };
+
+
+    //! Monte Carlo model working on blocks of paths
+    /*! It provides the same addSamples/sampleAccumulator interface
+        as MonteCarloModel, but simulates its samples a block at a
+        time and feeds them to the statistics one block at a time;
+        no Path object is built and no virtual call is made per
+        sample. Sample weights are taken to be 1.
+
+        If a control pricer is given, the control is evaluated on the
+        same block as the option and used as in MonteCarloModel, i.e.,
+        with a unit coefficient; the sums needed to estimate the
+        optimal coefficient are kept as well.
+
+        Buffers are carved from the given arena, if any; storage for
+        the samples is reserved before each call to addSamples, so
+        that the sample loop does not allocate.
+
+        If the generator samples the terminal variate by groups (see
+        BlockSampling) each group contributes its mean, weighted by
+        its number of paths, as a single sample to the statistics.
+    */
+    template <class RNG, class S>
+    class EuropeanBlockModel_2 : private boost::noncopyable {
+      public:
+        typedef BlockPathGenerator<CachedSequenceGenerator<RNG> >
+                                                    block_generator_type;
+        EuropeanBlockModel_2(
+                 const boost::shared_ptr<block_generator_type>& generator,
+                 const boost::shared_ptr<EuropeanPathPricer_2>& pricer,
+                 bool antitheticVariate,
+                 const boost::shared_ptr<EuropeanPathPricer_2>& controlPricer =
+                                    boost::shared_ptr<EuropeanPathPricer_2>(),
+                 Real controlValue = Null<Real>(),
+                 const boost::shared_ptr<EuropeanGreeksPathPricer_2>&
+                     greeksPricer =
+                         boost::shared_ptr<EuropeanGreeksPathPricer_2>(),
+                 MonteCarloArena* arena = 0);
+        void addSamples(Size samples);
+        //! prices n samples with the given terminal values
+        /*! If antithetic paths are used, the antithetic of the j-th
+            terminal value is the (n+j)-th one. */
+        void addTerminalValues(const Real* terminal, Size n);
+        const S& sampleAccumulator() const { return sampleAccumulator_; }
+        //! variance-minimizing coefficient of the control
+        /*! It is estimated from the samples added so far, before the
+            control was subtracted, and is null if no control pricer
+            was given or if the control samples have no variance. */
+        Real controlCoefficient() const;
+        //! \name Terminal-value record
+        /*! When recording is enabled, the terminal values divided by
+            the initial value of the underlying are appended to the
+            record; for each sample, the original path is followed by
+            its antithetic, if any.
+        */
+        //@{
+        void recordTerminalValues(bool b = true) { recording_ = b; }
+        std::vector<Real>& terminalValueRecord() { return record_; }
+        //@}
+        //! \name Payoff sketch
+        /*! When enabled, the discounted payoff of each path, weighted
+            by its likelihood ratio, is added to the sketch.
+        */
+        //@{
+        void sketchPayoffs(Real compression = 200.0);
+        QuantileSketch& payoffSketch() { return *sketch_; }
+        //@}
+        //! \name Greeks statistics
+        /*! they are only filled when a Greeks pricer is given. */
+        //@{
+        const S& deltaAccumulator() const { return deltaAccumulator_; }
+        const S& gammaAccumulator() const { return gammaAccumulator_; }
+        const S& vegaAccumulator() const { return vegaAccumulator_; }
+        //@}
+      private:
+        void addToStatistics(S& stats, const Real* values, Size n) const;
+        void addControlSums(const Real* values, const Real* controls,
+                            Size n);
+        boost::shared_ptr<block_generator_type> generator_;
+        boost::shared_ptr<EuropeanPathPricer_2> pricer_;
+        bool antitheticVariate_;
+        boost::shared_ptr<EuropeanPathPricer_2> controlPricer_;
+        Real controlValue_;
+        // weighted sums of the samples x and of their controls c
+        Real weightSum_, valueSum_, controlSum_;
+        Real controlSquareSum_, productSum_;
+        boost::shared_ptr<EuropeanGreeksPathPricer_2> greeksPricer_;
+        S sampleAccumulator_;
+        S deltaAccumulator_, gammaAccumulator_, vegaAccumulator_;
+        MonteCarloArena ownArena_;
+        Real *values_, *controlValues_, *ratios_;
+        Real *deltas_, *gammas_, *vegas_;
+        bool recording_;
+        std::vector<Real> record_;
+        boost::shared_ptr<QuantileSketch> sketch_;
+    };
+
+
     // inline definitions
 
     template <class RNG, class S>
@@ -116,23 +684,825 @@ namespace QuantLib {
              Size requiredSamples,
              Real requiredTolerance,
              Size maxSamples,
-             BigNatural seed)
+             BigNatural seed,
+             bool terminalSampling,
+             Size threads,
+             Size blockSize,
+             EuropeanControlVariate::Type controlVariate,
+             bool greeks,
+             Size randomizations,
+             bool importanceSampling,
+             BlockSampling::Type terminalVariateSampling,
+             Size samplingGroupSize,
+             bool incrementalRepricing,
+             bool commonRandomNumbers,
+             const std::string& checkpointFile,
+             Size checkpointInterval,
+             const std::vector<Real>& quantileLevels,
+             Real sketchCompression,
+             Size pilotSamples,
+             bool singlePrecision)
     : MCVanillaEngine<SingleVariate,RNG,S>(process,
                                            timeSteps,
                                            timeStepsPerYear,
                                            brownianBridge,
                                            antitheticVariate,
-                                           false,
+                                           controlVariate !=
+                                               EuropeanControlVariate::None,
                                            requiredSamples,
                                            requiredTolerance,
                                            maxSamples,
-                                           seed) {}
+                                           seed),
+      terminalSampling_(terminalSampling), threads_(threads),
+      blockSize_(blockSize), controlVariateType_(controlVariate),
+      greeks_(greeks), randomizations_(randomizations),
+      importanceSampling_(importanceSampling),
+      terminalVariateSampling_(terminalVariateSampling),
+      samplingGroupSize_(samplingGroupSize),
+      incrementalRepricing_(incrementalRepricing),
+      commonRandomNumbers_(commonRandomNumbers),
+      checkpointFile_(checkpointFile), checkpointInterval_(checkpointInterval),
+      quantileLevels_(quantileLevels), sketchCompression_(sketchCompression),
+      pilotSamples_(pilotSamples), singlePrecision_(singlePrecision),
+      controlCoefficient_(1.0),
+      cachedRiskFreeRate_(Null<Rate>()), cachedDividendYield_(Null<Rate>()),
+      cachedVolatility_(Null<Volatility>()), cachedMaturity_(Null<Time>()) {
+        QL_REQUIRE(threads > 0, "at least one thread required");
+        QL_REQUIRE(threads == 1 ||
+                   RandomAccessTraits<RNG>::allowsRandomAccess ||
+                   RandomizationTraits<RNG>::isRandomized ||
+                   singlePrecision,
+                   "multiple threads require a random-access policy");
+        QL_REQUIRE(!incrementalRepricing ||
+                   (!importanceSampling &&
+                    terminalVariateSampling == BlockSampling::Independent &&
+                    !RandomizationTraits<RNG>::isRandomized),
+                   "incremental repricing not available with importance "
+                   "sampling, grouped sampling or randomized sequences");
+        QL_REQUIRE(!commonRandomNumbers || seed != 0,
+                   "common random numbers require a non-null seed");
+        QL_REQUIRE(checkpointFile.empty() ||
+                   (!incrementalRepricing &&
+                    !RandomizationTraits<RNG>::isRandomized),
+                   "checkpoints not available in incremental mode "
+                   "or with randomized sequences");
+        QL_REQUIRE(checkpointFile.empty() || checkpointInterval > 0,
+                   "null checkpoint interval given");
+        QL_REQUIRE(checkpointFile.empty() || seed != 0,
+                   "checkpoints require a non-null seed");
+        QL_REQUIRE(checkpointFile.empty() || quantileLevels.empty(),
+                   "quantiles not available with checkpoints");
+        QL_REQUIRE(pilotSamples == Null<Size>() ||
+                   (pilotSamples > 1 &&
+                    !RandomizationTraits<RNG>::isRandomized),
+                   "pilot run requires at least two samples and "
+                   "non-randomized sequences");
+        QL_REQUIRE(!singlePrecision ||
+                   (terminalSampling &&
+                    controlVariate == EuropeanControlVariate::None &&
+                    !greeks && !importanceSampling &&
+                    terminalVariateSampling == BlockSampling::Independent &&
+                    !incrementalRepricing && !commonRandomNumbers &&
+                    quantileLevels.empty() &&
+                    !RandomizationTraits<RNG>::isRandomized),
+                   "single precision requires plain terminal sampling");
+        for (Size i=0; i<quantileLevels.size(); ++i)
+            QL_REQUIRE(quantileLevels[i] > 0.0 && quantileLevels[i] < 1.0,
+                       "quantile level (" << quantileLevels[i]
+                       << ") out of range");
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::calculate() const {
+        if (this->controlVariate_) {
+            estimateControlCoefficient();
+            this->results_.additionalResults["controlVariateCoefficient"] =
+                controlCoefficient_;
+        }
+
+        if (incrementalRepricing_) {
+            calculateIncrementally();
+            return;
+        }
+
+        if (singlePrecision_) {
+            simulate<float_model_type>();
+            return;
+        }
+
+        if (RandomizationTraits<RNG>::isRandomized) {
+            if (!blockSimulation())
+                simulateRandomized<model_type>();
+            else
+                simulateRandomized<block_model_type>();
+            return;
+        }
+
+        if (threads_ == 1 && !blockSimulation() && checkpointFile_.empty()
+            && pilotSamples_ == Null<Size>()) {
+            MCVanillaEngine<SingleVariate,RNG,S>::calculate();
+            return;
+        }
+
+        if (!blockSimulation())
+            simulate<model_type>();
+        else
+            simulate<block_model_type>();
+    }
+
+
+    template <class RNG, class S>
+    template <class Model>
+    inline void MCEuropeanEngine_2<RNG,S>::simulate() const {
+
+        QL_REQUIRE(this->requiredTolerance_ != Null<Real>() ||
+                   this->requiredSamples_ != Null<Size>(),
+                   "neither tolerance nor number of samples set");
+
+        // the single-precision kernel draws from a counter-based stream
+        const bool randomAccess =
+            RandomAccessTraits<RNG>::allowsRandomAccess || singlePrecision_;
+
+        boost::shared_ptr<EuropeanPathPricer_2> pricer =
+            europeanPathPricer();
+        boost::shared_ptr<EuropeanPathPricer_2> controlPricer;
+        Real controlValue = Null<Real>();
+        if (this->controlVariate_) {
+            controlPricer = europeanControlPathPricer();
+            controlValue = controlVariateValue();
+        }
+        boost::posix_time::ptime start =
+            boost::posix_time::microsec_clock::universal_time();
+        S stats, deltas, gammas, vegas;
+        Size sampleNumber = 0;
+        // same schedule as McSimulation::value, on merged statistics,
+        // unless the samples are planned after a pilot run
+        Real tolerance = this->requiredTolerance_;
+        const bool planning = (tolerance != Null<Real>() &&
+                               pilotSamples_ != Null<Size>());
+        Size plannedSamples = Null<Size>();
+        Real predictedError = Null<Real>();
+        Size pending = (tolerance == Null<Real>() ? this->requiredSamples_ :
+                        planning ? pilotSamples_ : Size(1023));
+        Size maxSamples = (this->maxSamples_ != Null<Size>() ?
+                           this->maxSamples_ : Size(QL_MAX_INTEGER));
+        // sequences drawn from the stream, if not random-access
+        std::vector<Size> sequences(threads_, 0);
+
+        const bool checkpoints = !checkpointFile_.empty();
+        McCheckpoint checkpoint;
+        std::vector<S*> saved(1, &stats);
+        if (greeks_) {
+            saved.push_back(&deltas);
+            saved.push_back(&gammas);
+            saved.push_back(&vegas);
+        }
+        if (checkpoints) {
+            checkpoint.seed = this->seed_;
+            checkpoint.policy = typeid(RNG).name();
+            checkpoint.configuration = checkpointConfiguration();
+            if (checkpoint.load(checkpointFile_, saved)) {
+                sampleNumber = checkpoint.sampleNumber;
+                pending = checkpoint.pendingSamples;
+                sequences = checkpoint.sequences;
+            }
+        }
+
+        // buffers of the previous calculation are no longer in use
+        arena_.reset();
+        std::vector<boost::shared_ptr<Model> > workers(threads_);
+        if (!randomAccess) {
+            // a single thread, drawing the whole stream in order
+            QL_REQUIRE(threads_ == 1,
+                       "multiple threads require a random-access policy");
+            workers[0] = newModel(this->seed_, sequences[0], pricer,
+                                  controlPricer, controlValue,
+                                  (Model*)(0));
+        }
+
+        QuantileSketch sketch(sketchCompression_);
+        std::vector<Size> merged(threads_, 0);
+        for (;;) {
+            // with checkpoints, the batch is run a chunk at a time
+            while (pending > 0) {
+                Size chunk = checkpoints ?
+                    std::min(pending, checkpointInterval_) : pending;
+                if (randomAccess) {
+                    // the new workers take over the buffers of the old ones
+                    arena_.reset();
+                    Size first = sampleNumber;
+                    for (Size i=0; i<threads_; ++i) {
+                        workers[i] = newModel(this->seed_, first, pricer,
+                                              controlPricer, controlValue,
+                                              (Model*)(0));
+                        merged[i] = 0;
+                        first += detail::batchShare(chunk, threads_, i);
+                    }
+                }
+                addSamples(workers, chunk);
+                sampleNumber += chunk;
+                pending -= chunk;
+                stats.reserve(sampleNumber);
+                if (greeks_) {
+                    deltas.reserve(sampleNumber);
+                    gammas.reserve(sampleNumber);
+                    vegas.reserve(sampleNumber);
+                }
+                for (Size i=0; i<threads_; ++i) {
+                    const S& partial = workers[i]->sampleAccumulator();
+                    detail::addStatistics(stats, partial, merged[i]);
+                    if (greeks_)
+                        addGreeks(deltas, gammas, vegas,
+                                  *workers[i], merged[i]);
+                    if (incrementalRepricing_)
+                        addTerminalValueRecord(*workers[i]);
+                    if (!quantileLevels_.empty())
+                        addSketch(sketch, *workers[i]);
+                    merged[i] = partial.samples();
+                    sequences[i] += detail::batchShare(chunk, threads_, i);
+                }
+                if (checkpoints) {
+                    checkpoint.sampleNumber = sampleNumber;
+                    checkpoint.pendingSamples = pending;
+                    checkpoint.sequences = sequences;
+                    checkpoint.save(checkpointFile_,
+                                    std::vector<const S*>(saved.begin(),
+                                                          saved.end()));
+                }
+            }
+
+            if (tolerance == Null<Real>())
+                break;
+            Real error = stats.errorEstimate();
+            if (plannedSamples == Null<Size>() && error <= tolerance) {
+                plannedSamples = sampleNumber;
+                predictedError = error;
+            }
+            if (error <= tolerance)
+                break;
+            QL_REQUIRE(sampleNumber < maxSamples,
+                       "max number of samples (" << maxSamples
+                       << ") reached, while error (" << error
+                       << ") is still above tolerance (" << tolerance << ")");
+            Real order = error*error/tolerance/tolerance;
+            if (planning) {
+                // the error decreases as the inverse square root of the
+                // number of samples; the margin makes a top-up unlikely
+                Real required = std::ceil(sampleNumber*order*1.1);
+                pending = Size(std::min<Real>(required - sampleNumber,
+                                              QL_MAX_INTEGER));
+                if (plannedSamples == Null<Size>()) {
+                    plannedSamples = sampleNumber + pending;
+                    predictedError =
+                        error*std::sqrt(Real(sampleNumber)/plannedSamples);
+                }
+            } else {
+                // conservative estimate of how many samples are needed
+                pending =
+                    Size(std::max<Real>(sampleNumber*order*0.8 - sampleNumber,
+                                        1023.0));
+            }
+            pending = std::min(pending, maxSamples-sampleNumber);
+        }
+
+        if (checkpoints)
+            std::remove(checkpointFile_.c_str());
+        setResults(stats, deltas, gammas, vegas,
+                   pricer, controlPricer, controlValue);
+        if (!quantileLevels_.empty())
+            setQuantileResults(sketch);
+        if (planning) {
+            boost::posix_time::time_duration elapsed =
+                boost::posix_time::microsec_clock::universal_time() - start;
+            this->results_.additionalResults["plannedSamples"] =
+                plannedSamples;
+            this->results_.additionalResults["predictedErrorEstimate"] =
+                predictedError;
+            this->results_.additionalResults["wallTime"] =
+                elapsed.total_microseconds()/1.0e6;
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline std::vector<Real>
+    MCEuropeanEngine_2<RNG,S>::checkpointConfiguration() const {
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+        boost::shared_ptr<ConstantBlackScholesProcess> process =
+            constantProcess();
+        TimeGrid grid = this->timeGrid();
+        /* everything the simulated samples depend on, except for
+           the seed and the random-number policy, which the checkpoint
+           saves as an integer and as a name */
+        std::vector<Real> configuration;
+        configuration.push_back(Real(threads_));
+        configuration.push_back(Real(randomizations_));
+        configuration.push_back(Real(blockSimulation() ?
+                                     effectiveBlockSize() : 0));
+        configuration.push_back(Real(grid.size()));
+        configuration.push_back(grid.back());
+        configuration.push_back(this->brownianBridge_ ? 1.0 : 0.0);
+        configuration.push_back(this->antitheticVariate_ ? 1.0 : 0.0);
+        configuration.push_back(Real(controlVariateType_));
+        configuration.push_back(greeks_ ? 1.0 : 0.0);
+        configuration.push_back(importanceSampling_ ? 1.0 : 0.0);
+        configuration.push_back(singlePrecision_ ? 1.0 : 0.0);
+        configuration.push_back(Real(terminalVariateSampling_));
+        configuration.push_back(Real(samplingGroupSize_));
+        configuration.push_back(Real(checkpointInterval_));
+        configuration.push_back(Real(payoff->optionType()));
+        configuration.push_back(payoff->strike());
+        configuration.push_back(process->x0());
+        configuration.push_back(process->riskFreeRate());
+        configuration.push_back(process->dividendYield());
+        configuration.push_back(process->volatility());
+        return configuration;
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::setResults(
+               const S& stats, const S& deltas, const S& gammas,
+               const S& vegas,
+               const boost::shared_ptr<EuropeanPathPricer_2>& pricer,
+               const boost::shared_ptr<EuropeanPathPricer_2>& controlPricer,
+               Real controlValue) const {
+        this->mcModel_ = boost::shared_ptr<model_type>(
+            new model_type(pathGenerator(), pricer, stats,
+                           this->antitheticVariate_,
+                           controlPricer, controlValue));
+
+        this->results_.value = stats.mean();
+        if (RNG::allowsErrorEstimate)
+            this->results_.errorEstimate = stats.errorEstimate();
+        if (greeks_) {
+            this->results_.delta = deltas.mean();
+            this->results_.gamma = gammas.mean();
+            this->results_.vega = vegas.mean();
+            if (RNG::allowsErrorEstimate) {
+                this->results_.additionalResults["deltaErrorEstimate"] =
+                    deltas.errorEstimate();
+                this->results_.additionalResults["gammaErrorEstimate"] =
+                    gammas.errorEstimate();
+                this->results_.additionalResults["vegaErrorEstimate"] =
+                    vegas.errorEstimate();
+            }
+        }
+        // per-path variance, when samples are group means
+        if (importanceSampling_)
+            setImportanceSamplingResults(
+                         pricer, stats.variance() * samplingGroupSize_);
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::setImportanceSamplingResults(
+               const boost::shared_ptr<EuropeanPathPricer_2>& pricer,
+               Real variance) const {
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        boost::shared_ptr<ConstantBlackScholesProcess> process =
+            constantProcess();
+        Time maturity = this->timeGrid().back();
+        this->results_.additionalResults["importanceSamplingShift"] =
+            detail::europeanImportanceShift(payoff->optionType(),
+                                            payoff->strike(),
+                                            *process, maturity);
+        if (variance > 0.0) {
+            Real plainVariance = detail::europeanPayoffVariance(
+                             payoff->optionType(), payoff->strike(),
+                             pricer->discount(), *process, maturity);
+            this->results_.additionalResults["varianceReduction"] =
+                plainVariance/variance;
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::addGreeks(
+                                     S& delta, S& gamma, S& vega,
+                                     const block_model_type& model,
+                                     Size first) const {
+        detail::addStatistics(delta, model.deltaAccumulator(), first);
+        detail::addStatistics(gamma, model.gammaAccumulator(), first);
+        detail::addStatistics(vega, model.vegaAccumulator(), first);
+    }
+
+
+    template <class RNG, class S>
+    template <class Model>
+    inline void MCEuropeanEngine_2<RNG,S>::simulateRandomized() const {
+
+        QL_REQUIRE(this->requiredTolerance_ != Null<Real>() ||
+                   this->requiredSamples_ != Null<Size>(),
+                   "neither tolerance nor number of samples set");
+        const Size randomizations = randomizations_;
+        QL_REQUIRE(randomizations > 1,
+                   "at least two randomizations required");
+
+        boost::shared_ptr<EuropeanPathPricer_2> pricer =
+            europeanPathPricer();
+        boost::shared_ptr<EuropeanPathPricer_2> controlPricer;
+        Real controlValue = Null<Real>();
+        if (this->controlVariate_) {
+            controlPricer = europeanControlPathPricer();
+            controlValue = controlVariateValue();
+        }
+        arena_.reset();
+        /* one randomization per model; consecutive seeds are distinct
+           Philox keys, hence independent scramblings of the same
+           points, and cannot collide as seeds drawn at random might */
+        std::vector<boost::shared_ptr<Model> > workers(randomizations);
+        BigNatural firstSeed = (this->seed_ != 0 ? this->seed_ :
+                                BigNatural(SeedGenerator::instance().get()));
+        for (Size k=0; k<randomizations; ++k)
+            workers[k] = newModel(firstSeed+k, 0, pricer,
+                                  controlPricer, controlValue,
+                                  (Model*)(0));
+
+        Real tolerance = this->requiredTolerance_;
+        Size points = (tolerance != Null<Real>() ?
+                       Size(1024) :
+                       (this->requiredSamples_+randomizations-1)
+                                                         / randomizations);
+        Size maxPoints = (this->maxSamples_ != Null<Size>() ?
+                          this->maxSamples_ : Size(QL_MAX_INTEGER))
+                       / randomizations;
+        Size pointNumber = 0;
+        S estimates, deltas, gammas, vegas;
+        for (;;) {
+            // randomizations are run a group of threads_ at a time
+            for (Size k=0; k<randomizations; k+=threads_) {
+                Size n = std::min(threads_, randomizations-k);
+                std::vector<boost::shared_ptr<Model> > group(
+                             workers.begin()+k, workers.begin()+k+n);
+                runWorkers(group, std::vector<Size>(n, points));
+            }
+            pointNumber += points;
+
+            estimates.reset();
+            deltas.reset();
+            gammas.reset();
+            vegas.reset();
+            for (Size k=0; k<randomizations; ++k) {
+                estimates.add(workers[k]->sampleAccumulator().mean());
+                if (greeks_)
+                    addGreekMeans(deltas, gammas, vegas, *workers[k]);
+            }
+
+            if (tolerance == Null<Real>())
+                break;
+            Real error = estimates.errorEstimate();
+            if (error <= tolerance)
+                break;
+            QL_REQUIRE(pointNumber < maxPoints,
+                       "max number of samples ("
+                       << maxPoints*randomizations
+                       << ") reached, while error (" << error
+                       << ") is still above tolerance (" << tolerance << ")");
+            // doubling keeps the Sobol points balanced
+            points = std::min(pointNumber, maxPoints-pointNumber);
+        }
+
+        /* the statistics of the single randomizations are not kept;
+           the model accumulates their estimates instead, one sample
+           per randomization */
+        this->mcModel_ = boost::shared_ptr<model_type>(
+            new model_type(pathGenerator(), pricer, estimates,
+                           this->antitheticVariate_,
+                           controlPricer, controlValue));
+
+        this->results_.value = estimates.mean();
+        this->results_.errorEstimate = estimates.errorEstimate();
+        if (greeks_) {
+            this->results_.delta = deltas.mean();
+            this->results_.gamma = gammas.mean();
+            this->results_.vega = vegas.mean();
+            this->results_.additionalResults["deltaErrorEstimate"] =
+                deltas.errorEstimate();
+            this->results_.additionalResults["gammaErrorEstimate"] =
+                gammas.errorEstimate();
+            this->results_.additionalResults["vegaErrorEstimate"] =
+                vegas.errorEstimate();
+        }
+        /* the variance a single path would need to give the same
+           error, which also accounts for the randomized points */
+        if (importanceSampling_) {
+            Real error = estimates.errorEstimate();
+            setImportanceSamplingResults(
+                          pricer, error*error * pointNumber*randomizations
+                                  * samplingGroupSize_);
+        }
+        if (!quantileLevels_.empty()) {
+            QuantileSketch sketch(sketchCompression_);
+            for (Size k=0; k<randomizations; ++k)
+                addSketch(sketch, *workers[k]);
+            setQuantileResults(sketch);
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::addGreekMeans(
+                                     S& delta, S& gamma, S& vega,
+                                     const block_model_type& model) const {
+        delta.add(model.deltaAccumulator().mean());
+        gamma.add(model.gammaAccumulator().mean());
+        vega.add(model.vegaAccumulator().mean());
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::addSketch(
+                                          QuantileSketch& sketch,
+                                          block_model_type& model) const {
+        // the worker sketch only keeps the samples not merged yet
+        sketch.merge(model.payoffSketch());
+        model.payoffSketch().reset();
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::setQuantileResults(
+                                       const QuantileSketch& sketch) const {
+        std::vector<Real> quantiles(quantileLevels_.size());
+        std::vector<Real> shortfalls(quantileLevels_.size());
+        for (Size i=0; i<quantileLevels_.size(); ++i) {
+            quantiles[i] = sketch.quantile(quantileLevels_[i]);
+            shortfalls[i] = sketch.tailMean(quantileLevels_[i]);
+        }
+        this->results_.additionalResults["payoffQuantiles"] = quantiles;
+        this->results_.additionalResults["expectedShortfall"] = shortfalls;
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::calculateIncrementally() const {
+        boost::shared_ptr<ConstantBlackScholesProcess> process =
+            constantProcess();
+        Time maturity = this->timeGrid().back();
+        if (!terminalValues_.empty() &&
+            process->riskFreeRate() == cachedRiskFreeRate_ &&
+            process->dividendYield() == cachedDividendYield_ &&
+            process->volatility() == cachedVolatility_ &&
+            maturity == cachedMaturity_) {
+            repriceFromTerminalValues();
+            if (this->requiredTolerance_ == Null<Real>() ||
+                this->results_.errorEstimate <= this->requiredTolerance_)
+                return;
+        }
+
+        terminalValues_.clear();
+        simulate<block_model_type>();
+        cachedRiskFreeRate_ = process->riskFreeRate();
+        cachedDividendYield_ = process->dividendYield();
+        cachedVolatility_ = process->volatility();
+        cachedMaturity_ = maturity;
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::repriceFromTerminalValues() const {
+        boost::shared_ptr<EuropeanPathPricer_2> pricer =
+            europeanPathPricer();
+        boost::shared_ptr<EuropeanPathPricer_2> controlPricer;
+        Real controlValue = Null<Real>();
+        if (this->controlVariate_) {
+            controlPricer = europeanControlPathPricer();
+            controlValue = controlVariateValue();
+        }
+        arena_.reset();
+        // the model is only used to price the samples
+        boost::shared_ptr<block_model_type> model =
+            newModel(this->seed_, 0, pricer, controlPricer, controlValue,
+                     (block_model_type*)(0));
+
+        // samples are replayed in the order they were merged
+        const Size blockSize = effectiveBlockSize();
+        const Size valuesPerSample = this->antitheticVariate_ ? 2 : 1;
+        const Size samples = terminalValues_.size()/valuesPerSample;
+        const Real x0 = constantProcess()->x0();
+        Real* terminal = arena_.allocate(2*blockSize);
+        for (Size first=0; first<samples; first+=blockSize) {
+            Size n = std::min(blockSize, samples-first);
+            const Real* record = &terminalValues_[valuesPerSample*first];
+            for (Size j=0; j<n; ++j) {
+                terminal[j] = x0*record[valuesPerSample*j];
+                if (this->antitheticVariate_)
+                    terminal[n+j] = x0*record[valuesPerSample*j+1];
+            }
+            model->addTerminalValues(terminal, n);
+        }
+
+        setResults(model->sampleAccumulator(), model->deltaAccumulator(),
+                   model->gammaAccumulator(), model->vegaAccumulator(),
+                   pricer, controlPricer, controlValue);
+        if (!quantileLevels_.empty())
+            setQuantileResults(model->payoffSketch());
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::addTerminalValueRecord(
+                                              block_model_type& model) const {
+        std::vector<Real>& record = model.terminalValueRecord();
+        terminalValues_.insert(terminalValues_.end(),
+                               record.begin(), record.end());
+        record.clear();
+    }
+
+
+    template <class RNG, class S>
+    inline Size MCEuropeanEngine_2<RNG,S>::effectiveBlockSize() const {
+        return blockSize_ != 0 ? blockSize_ : Size(4096);
+    }
+
+
+    template <class RNG, class S>
+    template <class Model>
+    inline void MCEuropeanEngine_2<RNG,S>::addSamples(
+                      const std::vector<boost::shared_ptr<Model> >& workers,
+                      Size samples) const {
+        Size n = workers.size();
+        std::vector<Size> shares(n);
+        for (Size i=0; i<n; ++i)
+            shares[i] = detail::batchShare(samples, n, i);
+        runWorkers(workers, shares);
+    }
+
+
+    template <class RNG, class S>
+    template <class Model>
+    inline void MCEuropeanEngine_2<RNG,S>::runWorkers(
+                      const std::vector<boost::shared_ptr<Model> >& workers,
+                      const std::vector<Size>& samples) const {
+        Size n = workers.size();
+        if (n == 1) {
+            workers[0]->addSamples(samples[0]);
+            return;
+        }
+        std::vector<std::string> errors(n);
+        boost::thread_group threads;
+        for (Size i=0; i<n; ++i) {
+            threads.create_thread(
+                detail::McWorkerTask<Model>(workers[i], samples[i],
+                                            errors[i]));
+        }
+        threads.join_all();
+        for (Size i=0; i<n; ++i)
+            QL_REQUIRE(errors[i].empty(), errors[i]);
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::model_type>
+    MCEuropeanEngine_2<RNG,S>::newModel(
+               BigNatural seed, BigNatural firstSequence,
+               const boost::shared_ptr<EuropeanPathPricer_2>& pricer,
+               const boost::shared_ptr<EuropeanPathPricer_2>& controlPricer,
+               Real controlValue,
+               model_type*) const {
+        return boost::shared_ptr<model_type>(
+            new model_type(pathGenerator(seed, firstSequence), pricer, S(),
+                           this->antitheticVariate_,
+                           controlPricer, controlValue));
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::block_model_type>
+    MCEuropeanEngine_2<RNG,S>::newModel(
+               BigNatural seed, BigNatural firstSequence,
+               const boost::shared_ptr<EuropeanPathPricer_2>& pricer,
+               const boost::shared_ptr<EuropeanPathPricer_2>& controlPricer,
+               Real controlValue,
+               block_model_type*) const {
+        boost::shared_ptr<block_model_type> model =
+            newBlockModel(seed, firstSequence, pricer, controlPricer,
+                          controlValue, false);
+        if (incrementalRepricing_)
+            model->recordTerminalValues();
+        if (!quantileLevels_.empty())
+            model->sketchPayoffs(sketchCompression_);
+        return model;
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::block_model_type>
+    MCEuropeanEngine_2<RNG,S>::newBlockModel(
+               BigNatural seed, BigNatural firstSequence,
+               const boost::shared_ptr<EuropeanPathPricer_2>& pricer,
+               const boost::shared_ptr<EuropeanPathPricer_2>& controlPricer,
+               Real controlValue,
+               bool pilot) const {
+        TimeGrid grid = this->timeGrid();
+        typename RNG::rsg_type generator =
+            RandomAccessTraits<RNG>::make_sequence_generator(grid.size()-1,
+                                                             seed,
+                                                             firstSequence);
+        typedef typename block_model_type::block_generator_type
+                                                        block_generator_type;
+        typedef typename block_generator_type::generator_type
+                                                        cached_generator_type;
+        boost::shared_ptr<ConstantBlackScholesProcess> process =
+            constantProcess();
+        boost::shared_ptr<block_generator_type> blockGenerator(
+            new block_generator_type(process, grid,
+                                     cached_generator_type(
+                                         generator, seed, firstSequence,
+                                         commonRandomNumbers_ && !pilot),
+                                     this->brownianBridge_,
+                                     effectiveBlockSize(), &arena_));
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+        if (terminalVariateSampling_ != BlockSampling::Independent)
+            blockGenerator->setSampling(terminalVariateSampling_,
+                                        samplingGroupSize_);
+        if (importanceSampling_)
+            blockGenerator->setTerminalShift(
+                detail::europeanImportanceShift(payoff->optionType(),
+                                                payoff->strike(),
+                                                *process, grid.back()));
+        boost::shared_ptr<EuropeanGreeksPathPricer_2> greeksPricer;
+        if (greeks_ && !pilot) {
+            boost::shared_ptr<GeneralizedBlackScholesProcess> bsProcess =
+                boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(
+                    this->process_);
+            QL_REQUIRE(bsProcess, "Black-Scholes process required");
+            Time maturity = grid.back();
+            greeksPricer = boost::shared_ptr<EuropeanGreeksPathPricer_2>(
+                new EuropeanGreeksPathPricer_2(
+                    payoff->optionType(), payoff->strike(),
+                    bsProcess->riskFreeRate()->discount(maturity),
+                    *process, maturity));
+        }
+        return boost::shared_ptr<block_model_type>(
+            new block_model_type(blockGenerator, pricer,
+                                 this->antitheticVariate_,
+                                 controlPricer, controlValue,
+                                 greeksPricer, &arena_));
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::float_model_type>
+    MCEuropeanEngine_2<RNG,S>::newModel(
+               BigNatural seed, BigNatural firstSequence,
+               const boost::shared_ptr<EuropeanPathPricer_2>& pricer,
+               const boost::shared_ptr<EuropeanPathPricer_2>&,
+               Real,
+               float_model_type*) const {
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+        boost::shared_ptr<EuropeanTerminalKernel<float> > kernel(
+            new EuropeanTerminalKernel<float>(payoff->optionType(),
+                                              payoff->strike(),
+                                              pricer->discount(),
+                                              *constantProcess(),
+                                              this->timeGrid().back(),
+                                              seed));
+        return boost::shared_ptr<float_model_type>(
+            new float_model_type(kernel, this->antitheticVariate_,
+                                 firstSequence, effectiveBlockSize()));
+    }
+
+
+    template <class RNG, class S>
+    inline TimeGrid MCEuropeanEngine_2<RNG,S>::timeGrid() const {
+        if (!terminalSampling_)
+            return MCVanillaEngine<SingleVariate,RNG,S>::timeGrid();
+
+        Date lastExerciseDate = this->arguments_.exercise->lastDate();
+        Time t = this->process_->time(lastExerciseDate);
+        return TimeGrid(t, 1);
+    }
 
 
     template <class RNG, class S>
     inline
     boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>
     MCEuropeanEngine_2<RNG,S>::pathPricer() const {
+        return europeanPathPricer();
+    }
+
+
+    template <class RNG, class S>
+    inline boost::shared_ptr<EuropeanPathPricer_2>
+    MCEuropeanEngine_2<RNG,S>::europeanPathPricer() const {
 
         boost::shared_ptr<PlainVanillaPayoff> payoff =
             boost::dynamic_pointer_cast<PlainVanillaPayoff>(
@@ -144,8 +1514,7 @@ namespace QuantLib {
                 this->process_);
         QL_REQUIRE(process, "Black-Scholes process required");
 
-        return boost::shared_ptr<
-                       typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>(
+        return boost::shared_ptr<EuropeanPathPricer_2>(
           new EuropeanPathPricer_2(
               payoff->optionType(),
               payoff->strike(),
@@ -153,13 +1522,132 @@ namespace QuantLib {
     }
 
 
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>
+    MCEuropeanEngine_2<RNG,S>::controlPathPricer() const {
+        return europeanControlPathPricer();
+    }
+
+
+    template <class RNG, class S>
+    inline boost::shared_ptr<EuropeanPathPricer_2>
+    MCEuropeanEngine_2<RNG,S>::europeanControlPathPricer() const {
+        switch (controlVariateType_) {
+          case EuropeanControlVariate::None:
+            return boost::shared_ptr<EuropeanPathPricer_2>();
+          case EuropeanControlVariate::DiscountedForward: {
+              boost::shared_ptr<GeneralizedBlackScholesProcess> process =
+                  boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(
+                      this->process_);
+              QL_REQUIRE(process, "Black-Scholes process required");
+              /* discount * S_T is the payoff of a zero-strike call; it
+                 is scaled by the coefficient, since the models subtract
+                 the control with a unit one */
+              return boost::shared_ptr<EuropeanPathPricer_2>(
+                  new EuropeanPathPricer_2(
+                      Option::Call, 0.0,
+                      controlCoefficient_ * process->riskFreeRate()->discount(
+                                                  this->timeGrid().back())));
+          }
+          default:
+            QL_FAIL("unknown control variate");
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline Real MCEuropeanEngine_2<RNG,S>::controlVariateValue() const {
+        QL_REQUIRE(controlVariateType_ ==
+                                    EuropeanControlVariate::DiscountedForward,
+                   "no control variate given");
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(
+                this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+        Time maturity = this->timeGrid().back();
+        return controlCoefficient_ * process->x0()
+             * process->dividendYield()->discount(maturity);
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::estimateControlCoefficient() const {
+        // the pilot sees the control with a unit coefficient
+        controlCoefficient_ = 1.0;
+        BigNatural pilotSeed = (this->seed_ != 0 ?
+                                this->seed_ + 0x9E3779B9UL :
+                                BigNatural(SeedGenerator::instance().get()));
+        arena_.reset();
+        boost::shared_ptr<block_model_type> pilot =
+            newBlockModel(pilotSeed, 0, europeanPathPricer(),
+                          europeanControlPathPricer(), controlVariateValue(),
+                          true);
+        pilot->addSamples(4096);
+        controlCoefficient_ = pilot->controlCoefficient();
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_generator_type>
+    MCEuropeanEngine_2<RNG,S>::pathGenerator() const {
+        return pathGenerator(this->seed_);
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_generator_type>
+    MCEuropeanEngine_2<RNG,S>::pathGenerator(
+                                            BigNatural seed,
+                                            BigNatural firstSequence) const {
+        TimeGrid grid = this->timeGrid();
+        typename RNG::rsg_type generator =
+            RandomAccessTraits<RNG>::make_sequence_generator(grid.size()-1,
+                                                             seed,
+                                                             firstSequence);
+        return boost::shared_ptr<path_generator_type>(
+                   new path_generator_type(constantProcess(), grid,
+                                           generator, this->brownianBridge_));
+    }
+
+
+    template <class RNG, class S>
+    inline boost::shared_ptr<ConstantBlackScholesProcess>
+    MCEuropeanEngine_2<RNG,S>::constantProcess() const {
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(
+                this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+
+        return makeConstantBlackScholesProcess(process,
+                                               this->timeGrid().back(),
+                                               payoff->strike());
+    }
+
+
     template <class RNG, class S>
     inline MakeMCEuropeanEngine_2<RNG,S>::MakeMCEuropeanEngine_2(
              const boost::shared_ptr<GeneralizedBlackScholesProcess>& process)
     : process_(process), antithetic_(false),
       steps_(Null<Size>()), stepsPerYear_(Null<Size>()),
       samples_(Null<Size>()), maxSamples_(Null<Size>()),
-      tolerance_(Null<Real>()), brownianBridge_(false), seed_(0) {}
+      tolerance_(Null<Real>()), brownianBridge_(false), seed_(0),
+      terminalSampling_(false), threads_(1), blockSize_(0),
+      controlVariate_(EuropeanControlVariate::None), greeks_(false),
+      randomizations_(16), importanceSampling_(false),
+      terminalVariateSampling_(BlockSampling::Independent),
+      samplingGroupSize_(1), incrementalRepricing_(false),
+      commonRandomNumbers_(false), checkpointInterval_(1000000),
+      sketchCompression_(200.0), pilotSamples_(Null<Size>()),
+      singlePrecision_(false) {}
 
     template <class RNG, class S>
     inline MakeMCEuropeanEngine_2<RNG,S>&
@@ -224,23 +1712,169 @@ namespace QuantLib {
         return *this;
     }
 
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withTerminalSampling(bool b) {
+        terminalSampling_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withThreads(Size threads) {
+        threads_ = threads;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withBlockSimulation(Size blockSize) {
+        blockSize_ = blockSize;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withControlVariate(
+                                         EuropeanControlVariate::Type c) {
+        controlVariate_ = c;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withGreeks(bool b) {
+        greeks_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withRandomizations(Size randomizations) {
+        QL_REQUIRE(randomizations > 1,
+                   "at least two randomizations required");
+        randomizations_ = randomizations;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withImportanceSampling(bool b) {
+        importanceSampling_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withStratifiedSampling(Size strata) {
+        QL_REQUIRE(terminalVariateSampling_ != BlockSampling::MomentMatching,
+                   "moment matching already set");
+        QL_REQUIRE(strata > 0, "null number of strata given");
+        terminalVariateSampling_ = BlockSampling::Stratified;
+        samplingGroupSize_ = strata;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withMomentMatching(Size groupSize) {
+        QL_REQUIRE(terminalVariateSampling_ != BlockSampling::Stratified,
+                   "stratified sampling already set");
+        QL_REQUIRE(groupSize > 1,
+                   "moment matching requires at least two paths per group");
+        terminalVariateSampling_ = BlockSampling::MomentMatching;
+        samplingGroupSize_ = groupSize;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withIncrementalRepricing(bool b) {
+        incrementalRepricing_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withCommonRandomNumbers(bool b) {
+        commonRandomNumbers_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withCheckpoint(const std::string& file,
+                                                  Size interval) {
+        QL_REQUIRE(interval > 0, "null checkpoint interval given");
+        checkpointFile_ = file;
+        checkpointInterval_ = interval;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withQuantiles(
+                                             const std::vector<Real>& levels,
+                                             Real compression) {
+        quantileLevels_ = levels;
+        sketchCompression_ = compression;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withPilotRun(Size samples) {
+        QL_REQUIRE(samples > 1, "at least two pilot samples required");
+        pilotSamples_ = samples;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withSinglePrecision(bool b) {
+        singlePrecision_ = b;
+        return *this;
+    }
+
     template <class RNG, class S>
     inline
     MakeMCEuropeanEngine_2<RNG,S>::operator boost::shared_ptr<PricingEngine>()
                                                                       const {
-        QL_REQUIRE(steps_ != Null<Size>() || stepsPerYear_ != Null<Size>(),
+        // the number of steps is irrelevant when sampling at maturity
+        Size steps = steps_;
+        if (terminalSampling_ && steps_ == Null<Size>()
+                              && stepsPerYear_ == Null<Size>())
+            steps = 1;
+        QL_REQUIRE(steps != Null<Size>() || stepsPerYear_ != Null<Size>(),
                    "number of steps not given");
-        QL_REQUIRE(steps_ == Null<Size>() || stepsPerYear_ == Null<Size>(),
+        QL_REQUIRE(steps == Null<Size>() || stepsPerYear_ == Null<Size>(),
                    "number of steps overspecified");
         return boost::shared_ptr<PricingEngine>(new
             MCEuropeanEngine_2<RNG,S>(process_,
-                                      steps_,
+                                      steps,
                                       stepsPerYear_,
                                       brownianBridge_,
                                       antithetic_,
                                       samples_, tolerance_,
                                       maxSamples_,
-                                      seed_));
+                                      seed_,
+                                      terminalSampling_,
+                                      threads_,
+                                      blockSize_,
+                                      controlVariate_,
+                                      greeks_,
+                                      randomizations_,
+                                      importanceSampling_,
+                                      terminalVariateSampling_,
+                                      samplingGroupSize_,
+                                      incrementalRepricing_,
+                                      commonRandomNumbers_,
+                                      checkpointFile_,
+                                      checkpointInterval_,
+                                      quantileLevels_,
+                                      sketchCompression_,
+                                      pilotSamples_,
+                                      singlePrecision_));
     }
 
 
@@ -258,6 +1892,234 @@ namespace QuantLib {
         return payoff_(path.back()) * discount_;
     }
 
+    inline void EuropeanPathPricer_2::operator()(const Real* underlyings,
+                                                 Real* values,
+                                                 Size n) const {
+        // no virtual call to the payoff inside the loop
+        const Real strike = payoff_.strike();
+        const Real sign = (payoff_.optionType() == Option::Call ? 1.0 : -1.0);
+        const Real discount = discount_;
+        for (Size i=0; i<n; ++i)
+            values[i] = discount * std::max(sign*(underlyings[i]-strike), 0.0);
+    }
+
+
+    inline EuropeanGreeksPathPricer_2::EuropeanGreeksPathPricer_2(
+                                  Option::Type type,
+                                  Real strike,
+                                  DiscountFactor discount,
+                                  const ConstantBlackScholesProcess& process,
+                                  Time maturity)
+    : sign_(type == Option::Call ? 1.0 : -1.0), strike_(strike),
+      discount_(discount), x0_(process.x0()),
+      sigma_(process.volatility()), maturity_(maturity),
+      logDrift_(process.drift(0.0, x0_)*maturity) {
+        QL_REQUIRE(maturity > 0.0, "positive maturity required");
+        QL_REQUIRE(sigma_ > 0.0, "positive volatility required");
+    }
+
+    inline void EuropeanGreeksPathPricer_2::operator()(
+                                  const Real* underlyings,
+                                  Real* deltas, Real* gammas, Real* vegas,
+                                  Size n) const {
+        const Real sigmaT = sigma_*maturity_;
+        for (Size i=0; i<n; ++i) {
+            Real s = underlyings[i];
+            // discounted derivative of the payoff at S_T
+            Real df = (sign_*(s-strike_) > 0.0 ? sign_*discount_ : 0.0);
+            Real w = (std::log(s/x0_) - logDrift_)/sigma_;
+            deltas[i] = df * s/x0_;
+            gammas[i] = df * s/(x0_*x0_) * (w/sigmaT - 1.0);
+            vegas[i] = df * s * (w - sigmaT);
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline EuropeanBlockModel_2<RNG,S>::EuropeanBlockModel_2(
+                 const boost::shared_ptr<block_generator_type>& generator,
+                 const boost::shared_ptr<EuropeanPathPricer_2>& pricer,
+                 bool antitheticVariate,
+                 const boost::shared_ptr<EuropeanPathPricer_2>& controlPricer,
+                 Real controlValue,
+                 const boost::shared_ptr<EuropeanGreeksPathPricer_2>&
+                                                               greeksPricer,
+                 MonteCarloArena* arena)
+    : generator_(generator), pricer_(pricer),
+      antitheticVariate_(antitheticVariate),
+      controlPricer_(controlPricer), controlValue_(controlValue),
+      weightSum_(0.0), valueSum_(0.0), controlSum_(0.0),
+      controlSquareSum_(0.0), productSum_(0.0),
+      greeksPricer_(greeksPricer),
+      controlValues_(0), ratios_(0), deltas_(0), gammas_(0), vegas_(0),
+      recording_(false) {
+        if (controlPricer_)
+            QL_REQUIRE(controlValue_ != Null<Real>(),
+                       "null control-variate value given");
+        if (!arena)
+            arena = &ownArena_;
+        Size capacity = 2*generator->blockSize();
+        values_ = arena->allocate(capacity);
+        if (controlPricer_)
+            controlValues_ = arena->allocate(capacity);
+        if (generator_->terminalShift() != 0.0)
+            ratios_ = arena->allocate(capacity);
+        if (greeksPricer_) {
+            deltas_ = arena->allocate(capacity);
+            gammas_ = arena->allocate(capacity);
+            vegas_ = arena->allocate(capacity);
+        }
+    }
+
+    template <class RNG, class S>
+    inline void EuropeanBlockModel_2<RNG,S>::addSamples(Size samples) {
+        const Size last = generator_->timeGrid().size()-1;
+        Size total = sampleAccumulator_.samples() + samples;
+        sampleAccumulator_.reserve(total);
+        if (greeksPricer_) {
+            deltaAccumulator_.reserve(total);
+            gammaAccumulator_.reserve(total);
+            vegaAccumulator_.reserve(total);
+        }
+        if (recording_)
+            record_.reserve(record_.size() +
+                            (antitheticVariate_ ? 2 : 1)*samples);
+        while (samples > 0) {
+            Size n = std::min(samples, generator_->blockSize());
+            generator_->next(n, antitheticVariate_);
+            const Real* terminal = generator_->values(last);
+            if (recording_) {
+                const Real x0 = generator_->x0();
+                for (Size j=0; j<n; ++j) {
+                    record_.push_back(terminal[j]/x0);
+                    if (antitheticVariate_)
+                        record_.push_back(terminal[n+j]/x0);
+                }
+            }
+            addTerminalValues(terminal, n);
+            samples -= n;
+        }
+    }
+
+    template <class RNG, class S>
+    inline void EuropeanBlockModel_2<RNG,S>::addTerminalValues(
+                                                      const Real* terminal,
+                                                      Size n) {
+        QL_REQUIRE(n <= generator_->blockSize(),
+                   "block size (" << generator_->blockSize()
+                   << ") exceeded");
+        Size m = antitheticVariate_ ? 2*n : n;
+        Real* values = values_;
+        (*pricer_)(terminal, values, m);
+        if (ratios_)
+            generator_->likelihoodRatios(terminal, ratios_, m);
+        if (sketch_)
+            sketch_->add(values, ratios_, m);
+        if (ratios_) {
+            for (Size j=0; j<m; ++j)
+                values[j] *= ratios_[j];
+        }
+        if (antitheticVariate_) {
+            for (Size j=0; j<n; ++j)
+                values[j] = (values[j] + values[n+j])/2.0;
+        }
+        if (controlPricer_) {
+            Real* controls = controlValues_;
+            (*controlPricer_)(terminal, controls, m);
+            if (ratios_) {
+                for (Size j=0; j<m; ++j)
+                    controls[j] *= ratios_[j];
+            }
+            if (antitheticVariate_) {
+                for (Size j=0; j<n; ++j)
+                    controls[j] = (controls[j] + controls[n+j])/2.0;
+            }
+            addControlSums(values, controls, n);
+            for (Size j=0; j<n; ++j)
+                values[j] += controlValue_ - controls[j];
+        }
+        addToStatistics(sampleAccumulator_, values, n);
+        if (greeksPricer_) {
+            Real *deltas = deltas_, *gammas = gammas_, *vegas = vegas_;
+            (*greeksPricer_)(terminal, deltas, gammas, vegas, m);
+            if (ratios_) {
+                for (Size j=0; j<m; ++j) {
+                    deltas[j] *= ratios_[j];
+                    gammas[j] *= ratios_[j];
+                    vegas[j] *= ratios_[j];
+                }
+            }
+            if (antitheticVariate_) {
+                for (Size j=0; j<n; ++j) {
+                    deltas[j] = (deltas[j] + deltas[n+j])/2.0;
+                    gammas[j] = (gammas[j] + gammas[n+j])/2.0;
+                    vegas[j] = (vegas[j] + vegas[n+j])/2.0;
+                }
+            }
+            addToStatistics(deltaAccumulator_, deltas, n);
+            addToStatistics(gammaAccumulator_, gammas, n);
+            addToStatistics(vegaAccumulator_, vegas, n);
+        }
+    }
+
+    template <class RNG, class S>
+    inline Real EuropeanBlockModel_2<RNG,S>::controlCoefficient() const {
+        if (weightSum_ == 0.0)
+            return 0.0;
+        Real covariance = productSum_ - valueSum_*controlSum_/weightSum_;
+        Real variance = controlSquareSum_ - controlSum_*controlSum_/weightSum_;
+        return variance > 0.0 ? covariance/variance : 0.0;
+    }
+
+    template <class RNG, class S>
+    inline void EuropeanBlockModel_2<RNG,S>::addControlSums(
+                                                   const Real* values,
+                                                   const Real* controls,
+                                                   Size n) {
+        // on the samples as they reach the statistics, i.e., group means
+        Size groupSize = generator_->groupSize();
+        for (Size first=0; first<n; first+=groupSize) {
+            Size m = std::min(groupSize, n-first);
+            Real x = 0.0, c = 0.0;
+            for (Size j=first; j<first+m; ++j) {
+                x += values[j];
+                c += controls[j];
+            }
+            x /= m;
+            c /= m;
+            weightSum_ += m;
+            valueSum_ += m*x;
+            controlSum_ += m*c;
+            controlSquareSum_ += m*c*c;
+            productSum_ += m*x*c;
+        }
+    }
+
+    template <class RNG, class S>
+    inline void EuropeanBlockModel_2<RNG,S>::sketchPayoffs(Real compression) {
+        sketch_ = boost::shared_ptr<QuantileSketch>(
+                                          new QuantileSketch(compression));
+    }
+
+    template <class RNG, class S>
+    inline void EuropeanBlockModel_2<RNG,S>::addToStatistics(
+                                                   S& stats,
+                                                   const Real* values,
+                                                   Size n) const {
+        Size groupSize = generator_->groupSize();
+        if (groupSize == 1) {
+            stats.addSequence(values, values+n);
+            return;
+        }
+        for (Size first=0; first<n; first+=groupSize) {
+            Size m = std::min(groupSize, n-first);
+            Real sum = 0.0;
+            for (Size j=first; j<first+m; ++j)
+                sum += values[j];
+            stats.add(sum/m, Real(m));
+        }
+    }
+
 }
 
 
@@ -0,0 +1,368 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file mceuropeanstripengine.hpp
+    \brief Monte Carlo pricing of a strip of European options
+*/
+
+#ifndef montecarlo_european_strip_engine_hpp
+#define montecarlo_european_strip_engine_hpp
+
+#include "mceuropeanengine.hpp"
+#include <ql/math/statistics/incrementalstatistics.hpp>
+
+namespace QuantLib {
+
+    //! default Monte Carlo traits for strips of single-variate payoffs
+    /*! The path pricer returns one value per payoff. */
+    template <class RNG = PseudoRandom>
+    struct SingleVariateStrip {
+        typedef RNG rng_traits;
+        typedef Path path_type;
+        typedef PathPricer<path_type,Array> path_pricer_type;
+        typedef typename RNG::rsg_type rsg_type;
+        typedef PathGenerator<rsg_type> path_generator_type;
+        enum { allowsErrorEstimate = RNG::allowsErrorEstimate };
+    };
+
+
+    //! statistics of each component of a sequence of samples
+    /*! Unlike GenericSequenceStatistics, no cross moments are
+        accumulated: adding a sample costs O(n) instead of O(n^2)
+        for n components.
+    */
+    template <class StatisticsType>
+    class GenericStripStatistics {
+      public:
+        typedef StatisticsType statistics_type;
+        explicit GenericStripStatistics(Size dimension = 0)
+        : stats_(dimension) {}
+        //! \name Inspectors
+        //@{
+        Size size() const { return stats_.size(); }
+        Size samples() const {
+            return stats_.empty() ? 0 : stats_[0].samples();
+        }
+        const statistics_type& operator[](Size i) const { return stats_[i]; }
+        std::vector<Real> mean() const;
+        std::vector<Real> errorEstimate() const;
+        //@}
+        //! \name Modifiers
+        //@{
+        template <class Sequence>
+        void add(const Sequence& sample, Real weight = 1.0) {
+            if (stats_.empty())
+                stats_.resize(sample.size());
+            QL_REQUIRE(sample.size() == stats_.size(),
+                       "sample size mismatch: " << stats_.size()
+                       << " required, " << sample.size() << " provided");
+            for (Size i=0; i<stats_.size(); ++i)
+                stats_[i].add(sample[i], weight);
+        }
+        void reset(Size dimension = 0) {
+            stats_ = std::vector<statistics_type>(dimension);
+        }
+        //@}
+      private:
+        std::vector<statistics_type> stats_;
+    };
+
+    typedef GenericStripStatistics<IncrementalStatistics> StripStatistics;
+
+
+    //! path pricer for a strip of plain-vanilla payoffs
+    /*! Each payoff is evaluated on the same path by the corresponding
+        EuropeanPathPricer_2.
+    */
+    class EuropeanStripPathPricer_2 : public PathPricer<Path,Array> {
+      public:
+        EuropeanStripPathPricer_2(
+              const std::vector<boost::shared_ptr<PlainVanillaPayoff> >&,
+              DiscountFactor discount);
+        Array operator()(const Path& path) const;
+      private:
+        std::vector<EuropeanPathPricer_2> pricers_;
+    };
+
+
+    //! Monte Carlo pricing of a strip of European options
+    /*! The terminal distribution of the underlying is simulated once
+        and every payoff in the strip is evaluated on the same
+        samples; this costs one simulation instead of one per strike.
+
+        Samples are drawn in one exact step to maturity from the
+        constant-coefficient snapshot of the process, with the
+        volatility read at the money; the smile of the volatility
+        surface, if any, is therefore not reproduced.
+
+        When a tolerance is given, the simulation stops when the
+        largest error estimate in the strip is below it.
+
+        \ingroup vanillaengines
+    */
+    template <class RNG = PseudoRandom, class S = StripStatistics>
+    class MCEuropeanStripEngine_2 {
+      public:
+        typedef SingleVariateStrip<RNG> mc_traits;
+        typedef typename mc_traits::path_generator_type path_generator_type;
+        typedef typename mc_traits::path_pricer_type path_pricer_type;
+        typedef MonteCarloModel<SingleVariateStrip,RNG,S> model_type;
+        MCEuropeanStripEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             const std::vector<boost::shared_ptr<PlainVanillaPayoff> >&
+                                                                    payoffs,
+             const Date& maturity,
+             bool antitheticVariate,
+             Size requiredSamples,
+             Real requiredTolerance,
+             Size maxSamples,
+             BigNatural seed);
+        void calculate() const;
+        //! \name Results
+        //@{
+        //! one value per payoff, in the order given
+        const std::vector<Real>& values() const { return values_; }
+        const std::vector<Real>& errorEstimates() const {
+            return errorEstimates_;
+        }
+        Size samples() const { return samples_; }
+        //@}
+      private:
+        Real maxError() const;
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        std::vector<boost::shared_ptr<PlainVanillaPayoff> > payoffs_;
+        Date maturity_;
+        bool antitheticVariate_;
+        Size requiredSamples_, maxSamples_;
+        Real requiredTolerance_;
+        BigNatural seed_;
+        mutable boost::shared_ptr<model_type> mcModel_;
+        mutable std::vector<Real> values_, errorEstimates_;
+        mutable Size samples_;
+    };
+
+
+    //! Monte Carlo European strip engine factory
+    template <class RNG = PseudoRandom, class S = StripStatistics>
+    class MakeMCEuropeanStripEngine_2 {
+      public:
+        MakeMCEuropeanStripEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>&,
+             const std::vector<boost::shared_ptr<PlainVanillaPayoff> >&,
+             const Date& maturity);
+        // named parameters
+        MakeMCEuropeanStripEngine_2& withSamples(Size samples);
+        MakeMCEuropeanStripEngine_2& withAbsoluteTolerance(Real tolerance);
+        MakeMCEuropeanStripEngine_2& withMaxSamples(Size samples);
+        MakeMCEuropeanStripEngine_2& withSeed(BigNatural seed);
+        MakeMCEuropeanStripEngine_2& withAntitheticVariate(bool b = true);
+        // conversion to engine
+        operator boost::shared_ptr<MCEuropeanStripEngine_2<RNG,S> >() const;
+      private:
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        std::vector<boost::shared_ptr<PlainVanillaPayoff> > payoffs_;
+        Date maturity_;
+        bool antithetic_;
+        Size samples_, maxSamples_;
+        Real tolerance_;
+        BigNatural seed_;
+    };
+
+
+    // inline definitions
+
+    template <class T>
+    inline std::vector<Real> GenericStripStatistics<T>::mean() const {
+        std::vector<Real> result(stats_.size());
+        for (Size i=0; i<stats_.size(); ++i)
+            result[i] = stats_[i].mean();
+        return result;
+    }
+
+    template <class T>
+    inline std::vector<Real> GenericStripStatistics<T>::errorEstimate() const {
+        std::vector<Real> result(stats_.size());
+        for (Size i=0; i<stats_.size(); ++i)
+            result[i] = stats_[i].errorEstimate();
+        return result;
+    }
+
+
+    inline EuropeanStripPathPricer_2::EuropeanStripPathPricer_2(
+         const std::vector<boost::shared_ptr<PlainVanillaPayoff> >& payoffs,
+         DiscountFactor discount) {
+        QL_REQUIRE(!payoffs.empty(), "no payoffs given");
+        pricers_.reserve(payoffs.size());
+        for (Size i=0; i<payoffs.size(); ++i)
+            pricers_.push_back(EuropeanPathPricer_2(payoffs[i]->optionType(),
+                                                    payoffs[i]->strike(),
+                                                    discount));
+    }
+
+    inline Array EuropeanStripPathPricer_2::operator()(
+                                                   const Path& path) const {
+        Array values(pricers_.size());
+        for (Size i=0; i<pricers_.size(); ++i)
+            values[i] = pricers_[i](path);
+        return values;
+    }
+
+
+    template <class RNG, class S>
+    inline MCEuropeanStripEngine_2<RNG,S>::MCEuropeanStripEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             const std::vector<boost::shared_ptr<PlainVanillaPayoff> >&
+                                                                    payoffs,
+             const Date& maturity,
+             bool antitheticVariate,
+             Size requiredSamples,
+             Real requiredTolerance,
+             Size maxSamples,
+             BigNatural seed)
+    : process_(process), payoffs_(payoffs), maturity_(maturity),
+      antitheticVariate_(antitheticVariate),
+      requiredSamples_(requiredSamples), maxSamples_(maxSamples),
+      requiredTolerance_(requiredTolerance), seed_(seed), samples_(0) {
+        QL_REQUIRE(!payoffs.empty(), "no payoffs given");
+        QL_REQUIRE(requiredTolerance != Null<Real>() ||
+                   requiredSamples != Null<Size>(),
+                   "neither tolerance nor number of samples set");
+        QL_REQUIRE(requiredTolerance == Null<Real>() ||
+                   RNG::allowsErrorEstimate,
+                   "chosen random generator policy "
+                   "does not allow an error estimate");
+    }
+
+    template <class RNG, class S>
+    inline void MCEuropeanStripEngine_2<RNG,S>::calculate() const {
+        Time maturity = process_->time(maturity_);
+        TimeGrid grid(maturity, 1);
+
+        boost::shared_ptr<StochasticProcess1D> constantProcess =
+            makeConstantBlackScholesProcess(process_, maturity);
+        typename RNG::rsg_type generator =
+            RNG::make_sequence_generator(1, seed_);
+        boost::shared_ptr<path_generator_type> pathGenerator(
+              new path_generator_type(constantProcess, grid,
+                                      generator, false));
+        boost::shared_ptr<path_pricer_type> pathPricer(
+              new EuropeanStripPathPricer_2(
+                      payoffs_, process_->riskFreeRate()->discount(maturity)));
+
+        mcModel_ = boost::shared_ptr<model_type>(
+                new model_type(pathGenerator, pathPricer, S(),
+                               antitheticVariate_));
+
+        if (requiredTolerance_ == Null<Real>()) {
+            mcModel_->addSamples(requiredSamples_);
+        } else {
+            // same schedule as McSimulation::value
+            Size maxSamples = (maxSamples_ != Null<Size>() ?
+                               maxSamples_ : Size(QL_MAX_INTEGER));
+            const Size minSamples = 1023;
+            mcModel_->addSamples(minSamples);
+            Size sampleNumber = minSamples;
+            Real error = maxError();
+            while (error > requiredTolerance_) {
+                QL_REQUIRE(sampleNumber < maxSamples,
+                           "max number of samples (" << maxSamples
+                           << ") reached, while error (" << error
+                           << ") is still above tolerance ("
+                           << requiredTolerance_ << ")");
+                Real order =
+                    error*error/requiredTolerance_/requiredTolerance_;
+                Size nextBatch = Size(std::max<Real>(
+                    sampleNumber*order*0.8 - sampleNumber, minSamples));
+                nextBatch = std::min(nextBatch, maxSamples-sampleNumber);
+                sampleNumber += nextBatch;
+                mcModel_->addSamples(nextBatch);
+                error = maxError();
+            }
+        }
+
+        const S& stats = mcModel_->sampleAccumulator();
+        values_ = stats.mean();
+        if (RNG::allowsErrorEstimate)
+            errorEstimates_ = stats.errorEstimate();
+        else
+            errorEstimates_ = std::vector<Real>(values_.size(), Null<Real>());
+        samples_ = stats.samples();
+    }
+
+    template <class RNG, class S>
+    inline Real MCEuropeanStripEngine_2<RNG,S>::maxError() const {
+        std::vector<Real> errors =
+            mcModel_->sampleAccumulator().errorEstimate();
+        return *std::max_element(errors.begin(), errors.end());
+    }
+
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanStripEngine_2<RNG,S>::MakeMCEuropeanStripEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             const std::vector<boost::shared_ptr<PlainVanillaPayoff> >&
+                                                                    payoffs,
+             const Date& maturity)
+    : process_(process), payoffs_(payoffs), maturity_(maturity),
+      antithetic_(false), samples_(Null<Size>()),
+      maxSamples_(Null<Size>()), tolerance_(Null<Real>()), seed_(0) {}
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanStripEngine_2<RNG,S>&
+    MakeMCEuropeanStripEngine_2<RNG,S>::withSamples(Size samples) {
+        QL_REQUIRE(tolerance_ == Null<Real>(),
+                   "tolerance already set");
+        samples_ = samples;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanStripEngine_2<RNG,S>&
+    MakeMCEuropeanStripEngine_2<RNG,S>::withAbsoluteTolerance(
+                                                          Real tolerance) {
+        QL_REQUIRE(samples_ == Null<Size>(),
+                   "number of samples already set");
+        QL_REQUIRE(RNG::allowsErrorEstimate,
+                   "chosen random generator policy "
+                   "does not allow an error estimate");
+        tolerance_ = tolerance;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanStripEngine_2<RNG,S>&
+    MakeMCEuropeanStripEngine_2<RNG,S>::withMaxSamples(Size samples) {
+        maxSamples_ = samples;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanStripEngine_2<RNG,S>&
+    MakeMCEuropeanStripEngine_2<RNG,S>::withSeed(BigNatural seed) {
+        seed_ = seed;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanStripEngine_2<RNG,S>&
+    MakeMCEuropeanStripEngine_2<RNG,S>::withAntitheticVariate(bool b) {
+        antithetic_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanStripEngine_2<RNG,S>::operator
+    boost::shared_ptr<MCEuropeanStripEngine_2<RNG,S> >() const {
+        return boost::shared_ptr<MCEuropeanStripEngine_2<RNG,S> >(new
+            MCEuropeanStripEngine_2<RNG,S>(process_,
+                                           payoffs_,
+                                           maturity_,
+                                           antithetic_,
+                                           samples_, tolerance_,
+                                           maxSamples_,
+                                           seed_));
+    }
+
+}
+
+
+#endif
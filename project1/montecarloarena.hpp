@@ -0,0 +1,100 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file montecarloarena.hpp
+    \brief Reusable storage for the buffers of a Monte Carlo calculation
+*/
+
+#ifndef montecarlo_arena_hpp
+#define montecarlo_arena_hpp
+
+#include <ql/types.hpp>
+#include <ql/errors.hpp>
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <list>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Region of memory from which Monte Carlo buffers are carved
+    /*! Buffers are handed out sequentially from a single region and
+        are all released at once by reset(); no memory is returned to
+        the heap in between. If the region is too small, the missing
+        buffers are allocated separately and the region is resized to
+        fit all of them at the next reset, so that a calculation that
+        is repeated with the same parameters does not allocate.
+
+        Buffers are aligned on 64-byte boundaries.
+
+        \ingroup mcarlo
+    */
+    class MonteCarloArena : private boost::noncopyable {
+      public:
+        //! the initial capacity is given as a number of Reals
+        explicit MonteCarloArena(Size capacity = 0);
+        //! a buffer of n Reals, valid until the next reset
+        Real* allocate(Size n);
+        //! makes the whole region available again
+        void reset();
+        //! \name Inspectors
+        //@{
+        Size capacity() const { return capacity_; }
+        Size used() const { return used_ + overflow_; }
+        //@}
+      private:
+        // Reals per 64-byte line
+        enum { alignment = 64/sizeof(Real) };
+        static Real* align(std::vector<Real>& v);
+        std::vector<Real> region_;
+        Real* begin_;
+        Size capacity_, used_, overflow_;
+        std::list<std::vector<Real> > overflowBuffers_;
+    };
+
+
+    // inline definitions
+
+    inline MonteCarloArena::MonteCarloArena(Size capacity)
+    : begin_(0), capacity_(0), used_(0), overflow_(0) {
+        if (capacity > 0) {
+            capacity_ = (capacity + alignment-1) / alignment * alignment;
+            region_.resize(capacity_ + alignment);
+            begin_ = align(region_);
+        }
+    }
+
+    inline Real* MonteCarloArena::align(std::vector<Real>& v) {
+        std::size_t address = reinterpret_cast<std::size_t>(&v[0]);
+        std::size_t offset = (64 - address % 64) % 64;
+        return &v[0] + offset/sizeof(Real);
+    }
+
+    inline Real* MonteCarloArena::allocate(Size n) {
+        Size size = (std::max<Size>(n, 1) + alignment-1)
+                  / alignment * alignment;
+        if (used_ + size <= capacity_) {
+            Real* buffer = begin_ + used_;
+            used_ += size;
+            return buffer;
+        }
+        overflowBuffers_.push_back(std::vector<Real>(size + alignment));
+        overflow_ += size;
+        return align(overflowBuffers_.back());
+    }
+
+    inline void MonteCarloArena::reset() {
+        if (overflow_ > 0) {
+            // grow to the size required by the last calculation
+            capacity_ = used_ + overflow_;
+            std::vector<Real>(capacity_ + alignment).swap(region_);
+            begin_ = align(region_);
+            overflowBuffers_.clear();
+            overflow_ = 0;
+        }
+        used_ = 0;
+    }
+
+}
+
+
+#endif
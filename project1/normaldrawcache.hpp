@@ -0,0 +1,302 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file normaldrawcache.hpp
+    \brief Cache of Gaussian draws for common random numbers
+*/
+
+#ifndef normal_draw_cache_hpp
+#define normal_draw_cache_hpp
+
+#include "counterbasedrng.hpp"
+#include <ql/patterns/singleton.hpp>
+#include <ql/methods/montecarlo/sample.hpp>
+#include <ql/types.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+#include <list>
+#include <map>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Global cache of the Gaussian sequences drawn by Monte Carlo runs
+    /*! Draws are stored per generator stream, i.e., per type of
+        sequence generator, seed, first sequence and dimension; runs
+        on time grids with the same number of steps share them, since
+        the draws do not depend on the times. When the memory used
+        exceeds the cap, the least recently used streams are evicted.
+
+        The cache is safe to use from multiple threads.
+
+        \ingroup mcarlo
+    */
+    class NormalDrawCache : public Singleton<NormalDrawCache> {
+        friend class Singleton<NormalDrawCache>;
+      public:
+        typedef boost::shared_ptr<const std::vector<Real> > draws_type;
+        struct Key {
+            std::string generator;
+            BigNatural seed, firstSequence;
+            Size dimension;
+            bool operator<(const Key& other) const;
+        };
+        //! \name Settings
+        //@{
+        //! maximum memory used by the draws, in bytes
+        void setMemoryCap(Size bytes);
+        Size memoryCap() const;
+        Size memoryUsed() const;
+        void clear();
+        //@}
+        //! \name Cache access
+        //@{
+        //! cached draws for the stream, or an empty pointer
+        draws_type draws(const Key& key);
+        //! stores the draws of a stream, unless shorter ones than cached
+        void store(const Key& key, const draws_type& draws);
+        //@}
+      private:
+        NormalDrawCache();
+        void evict(Size required);
+        typedef std::list<std::pair<Key,draws_type> > entries_type;
+        mutable boost::mutex mutex_;
+        // most recently used first
+        entries_type entries_;
+        std::map<Key,entries_type::iterator> index_;
+        Size cap_, used_;
+    };
+
+
+    //! Gaussian sequence generator reading from NormalDrawCache
+    /*! Sequences already in the cache are copied from it; the others
+        are drawn from the wrapped generator and offered to the cache
+        when the last copy of the wrapper is destroyed. If the cache
+        is disabled, sequences are passed through. Recording stops,
+        and nothing is offered to the cache, as soon as the stream
+        would exceed the memory cap.
+
+        The wrapped generator, built from the RNG policy, must start
+        at the given first sequence of the stream with the given
+        seed. Past the cached draws, it jumps ahead if the policy
+        allows random access (see RandomAccessTraits) and draws and
+        discards the cached sequences otherwise.
+    */
+    template <class RNG>
+    class CachedSequenceGenerator {
+      public:
+        typedef typename RNG::rsg_type GSG;
+        typedef typename GSG::sample_type sample_type;
+        CachedSequenceGenerator(const GSG& generator,
+                                BigNatural seed,
+                                BigNatural firstSequence,
+                                bool useCache);
+        const sample_type& nextSequence() const;
+        const sample_type& lastSequence() const { return *last_; }
+        Size dimension() const { return state_->generator.dimension(); }
+      private:
+        struct State {
+            State(const GSG& g) : generator(g), next(0), generated(0) {}
+            ~State();
+            GSG generator;
+            bool enabled, recording;
+            NormalDrawCache::Key key;
+            NormalDrawCache::draws_type cached;
+            Size cachedSequences, maxDraws;
+            std::vector<Real> drawn;
+            Size next, generated;
+        };
+        void catchUp(boost::true_type) const;
+        void catchUp(boost::false_type) const;
+        boost::shared_ptr<State> state_;
+        mutable sample_type sequence_;
+        mutable const sample_type* last_;
+    };
+
+
+    // inline definitions
+
+    inline bool NormalDrawCache::Key::operator<(const Key& other) const {
+        if (seed != other.seed)
+            return seed < other.seed;
+        if (firstSequence != other.firstSequence)
+            return firstSequence < other.firstSequence;
+        if (dimension != other.dimension)
+            return dimension < other.dimension;
+        return generator < other.generator;
+    }
+
+    inline NormalDrawCache::NormalDrawCache()
+    : cap_(256*1024*1024), used_(0) {}
+
+    inline void NormalDrawCache::setMemoryCap(Size bytes) {
+        boost::mutex::scoped_lock lock(mutex_);
+        cap_ = bytes;
+        evict(0);
+    }
+
+    inline Size NormalDrawCache::memoryCap() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return cap_;
+    }
+
+    inline Size NormalDrawCache::memoryUsed() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return used_;
+    }
+
+    inline void NormalDrawCache::clear() {
+        boost::mutex::scoped_lock lock(mutex_);
+        entries_.clear();
+        index_.clear();
+        used_ = 0;
+    }
+
+    inline NormalDrawCache::draws_type
+    NormalDrawCache::draws(const Key& key) {
+        boost::mutex::scoped_lock lock(mutex_);
+        std::map<Key,entries_type::iterator>::iterator i = index_.find(key);
+        if (i == index_.end())
+            return draws_type();
+        entries_.splice(entries_.begin(), entries_, i->second);
+        return i->second->second;
+    }
+
+    inline void NormalDrawCache::store(const Key& key,
+                                       const draws_type& draws) {
+        Size bytes = draws->size()*sizeof(Real);
+        boost::mutex::scoped_lock lock(mutex_);
+        std::map<Key,entries_type::iterator>::iterator i = index_.find(key);
+        if (i != index_.end()) {
+            if (i->second->second->size() >= draws->size())
+                return;
+            used_ -= i->second->second->size()*sizeof(Real);
+            entries_.erase(i->second);
+            index_.erase(i);
+        }
+        if (bytes > cap_)
+            return;
+        evict(bytes);
+        entries_.push_front(std::make_pair(key, draws));
+        index_[key] = entries_.begin();
+        used_ += bytes;
+    }
+
+    inline void NormalDrawCache::evict(Size required) {
+        while (!entries_.empty() && used_ + required > cap_) {
+            used_ -= entries_.back().second->size()*sizeof(Real);
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+
+
+    template <class RNG>
+    CachedSequenceGenerator<RNG>::CachedSequenceGenerator(
+                                                   const GSG& generator,
+                                                   BigNatural seed,
+                                                   BigNatural firstSequence,
+                                                   bool useCache)
+    : state_(new State(generator)),
+      sequence_(std::vector<Real>(generator.dimension()), 1.0),
+      last_(&sequence_) {
+        State& s = *state_;
+        s.enabled = s.recording = useCache;
+        s.cachedSequences = s.maxDraws = 0;
+        s.key.seed = seed;
+        s.key.firstSequence = firstSequence;
+        s.key.dimension = generator.dimension();
+        if (useCache) {
+            s.key.generator = typeid(GSG).name();
+            s.cached = NormalDrawCache::instance().draws(s.key);
+            if (s.cached)
+                s.cachedSequences = s.cached->size()/s.key.dimension;
+            // the cap is read once, rather than locked for at each draw
+            s.maxDraws = NormalDrawCache::instance().memoryCap()
+                       / sizeof(Real);
+        }
+    }
+
+    template <class RNG>
+    CachedSequenceGenerator<RNG>::State::~State() {
+        if (!recording || drawn.empty())
+            return;
+        try {
+            boost::shared_ptr<std::vector<Real> > draws(
+                                        new std::vector<Real>());
+            draws->reserve(cachedSequences*key.dimension + drawn.size());
+            if (cached)
+                draws->assign(cached->begin(),
+                              cached->begin()
+                                  + cachedSequences*key.dimension);
+            draws->insert(draws->end(), drawn.begin(), drawn.end());
+            NormalDrawCache::instance().store(key, draws);
+        } catch (...) {
+            // failing to cache the draws only loses the optimization
+        }
+    }
+
+    template <class RNG>
+    void CachedSequenceGenerator<RNG>::catchUp(boost::true_type) const {
+        State& s = *state_;
+        s.generator = RandomAccessTraits<RNG>::make_sequence_generator(
+                                     s.key.dimension, s.key.seed,
+                                     s.key.firstSequence + s.next);
+        s.generated = s.next;
+    }
+
+    template <class RNG>
+    void CachedSequenceGenerator<RNG>::catchUp(boost::false_type) const {
+        State& s = *state_;
+        while (s.generated < s.next) {
+            s.generator.nextSequence();
+            ++s.generated;
+        }
+    }
+
+    template <class RNG>
+    const typename CachedSequenceGenerator<RNG>::sample_type&
+    CachedSequenceGenerator<RNG>::nextSequence() const {
+        State& s = *state_;
+        if (!s.enabled) {
+            last_ = &s.generator.nextSequence();
+            return *last_;
+        }
+        const Size dimension = s.key.dimension;
+        if (s.next < s.cachedSequences) {
+            std::vector<Real>::const_iterator begin =
+                s.cached->begin() + s.next*dimension;
+            std::copy(begin, begin+dimension, sequence_.value.begin());
+            sequence_.weight = 1.0;
+            ++s.next;
+            last_ = &sequence_;
+            return sequence_;
+        }
+        // past the cached draws: the generator catches up, if needed
+        if (s.generated < s.next)
+            catchUp(boost::integral_constant<bool,
+                        RandomAccessTraits<RNG>::allowsRandomAccess>());
+        const sample_type& sample = s.generator.nextSequence();
+        ++s.generated;
+        ++s.next;
+        if (s.recording) {
+            if (s.cachedSequences*dimension + s.drawn.size() + dimension
+                                                              > s.maxDraws) {
+                // the stream would not fit in the cache anyway
+                s.recording = false;
+                std::vector<Real>().swap(s.drawn);
+            } else {
+                s.drawn.insert(s.drawn.end(),
+                               sample.value.begin(), sample.value.end());
+            }
+        }
+        last_ = &sample;
+        return sample;
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,222 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file quantilesketch.hpp
+    \brief Streaming quantile estimation in bounded memory
+*/
+
+#ifndef quantile_sketch_hpp
+#define quantile_sketch_hpp
+
+#include <ql/types.hpp>
+#include <ql/errors.hpp>
+#include <ql/math/comparison.hpp>
+#include <ql/mathconstants.h>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Mergeable sketch of a distribution of weighted samples
+    /*! This is a merging t-digest: samples are collected in a buffer
+        and periodically merged into a sorted list of centroids,
+        whose size is bounded by the compression parameter through
+        the arcsine scale function. Centroids near the tails hold
+        fewer samples than those near the median, so that extreme
+        quantiles are estimated with a small relative error.
+
+        The memory used is a few times the compression, regardless of
+        the number of samples; sketches filled by different threads
+        can be merged in time proportional to their size.
+
+        See T. Dunning and O. Ertl, "Computing extremely accurate
+        quantiles using t-digests", arXiv:1902.04023 (2019).
+    */
+    class QuantileSketch {
+      public:
+        explicit QuantileSketch(Real compression = 200.0);
+        //! \name Inputs
+        //@{
+        void add(Real value, Real weight = 1.0);
+        //! adds n values; if no weights are given, they are taken as 1
+        void add(const Real* values, const Real* weights, Size n);
+        void merge(const QuantileSketch& other);
+        void reset();
+        //@}
+        //! \name Inspectors
+        //@{
+        Real compression() const { return compression_; }
+        Real weightSum() const { return weight_ + bufferWeight_; }
+        Real min() const { return min_; }
+        Real max() const { return max_; }
+        //! the value below which a fraction p of the weight lies
+        Real quantile(Real p) const;
+        /*! mean of the values beyond the p-quantile, in the lower
+            tail if p is below 1/2 and in the upper tail otherwise. */
+        Real tailMean(Real p) const;
+        Size centroids() const;
+        //@}
+      private:
+        typedef std::pair<Real,Real> centroid;   // mean and weight
+        void compress() const;
+        Real limit(Real q) const;
+        Real compression_;
+        Size bufferSize_;
+        mutable std::vector<centroid> centroids_, buffer_, scratch_;
+        mutable Real weight_, bufferWeight_;
+        Real min_, max_;
+    };
+
+
+    // inline definitions
+
+    inline QuantileSketch::QuantileSketch(Real compression)
+    : compression_(compression), bufferSize_(Size(5*compression)),
+      weight_(0.0), bufferWeight_(0.0),
+      min_(QL_MAX_REAL), max_(-QL_MAX_REAL) {
+        QL_REQUIRE(compression >= 10.0,
+                   "compression (" << compression << ") too small");
+        // no allocation while adding samples
+        buffer_.reserve(bufferSize_);
+        centroids_.reserve(Size(compression_) + 1);
+        scratch_.reserve(bufferSize_ + Size(compression_) + 1);
+    }
+
+    inline void QuantileSketch::add(Real value, Real weight) {
+        if (weight <= 0.0)
+            return;
+        buffer_.push_back(centroid(value, weight));
+        bufferWeight_ += weight;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+        if (buffer_.size() >= bufferSize_)
+            compress();
+    }
+
+    inline void QuantileSketch::add(const Real* values,
+                                    const Real* weights,
+                                    Size n) {
+        for (Size i=0; i<n; ++i)
+            add(values[i], weights ? weights[i] : 1.0);
+    }
+
+    inline void QuantileSketch::merge(const QuantileSketch& other) {
+        other.compress();
+        for (Size i=0; i<other.centroids_.size(); ++i) {
+            buffer_.push_back(other.centroids_[i]);
+            bufferWeight_ += other.centroids_[i].second;
+            if (buffer_.size() >= bufferSize_)
+                compress();
+        }
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    inline void QuantileSketch::reset() {
+        centroids_.clear();
+        buffer_.clear();
+        weight_ = bufferWeight_ = 0.0;
+        min_ = QL_MAX_REAL;
+        max_ = -QL_MAX_REAL;
+    }
+
+    inline Real QuantileSketch::limit(Real q) const {
+        // k^{-1}(k(q) + 1) with k(q) = delta/(2 pi) asin(2q - 1)
+        Real k = compression_/(2.0*M_PI) * std::asin(2.0*q - 1.0) + 1.0;
+        if (k >= compression_/4.0)
+            return 1.0;
+        return (std::sin(2.0*M_PI*k/compression_) + 1.0)/2.0;
+    }
+
+    inline void QuantileSketch::compress() const {
+        if (buffer_.empty())
+            return;
+        scratch_.assign(centroids_.begin(), centroids_.end());
+        scratch_.insert(scratch_.end(), buffer_.begin(), buffer_.end());
+        std::sort(scratch_.begin(), scratch_.end());
+        Real total = weight_ + bufferWeight_;
+
+        centroids_.clear();
+        centroid current = scratch_[0];
+        Real cumulated = 0.0;
+        Real bound = total*limit(0.0);
+        for (Size i=1; i<scratch_.size(); ++i) {
+            const centroid& next = scratch_[i];
+            if (cumulated + current.second + next.second <= bound) {
+                current.second += next.second;
+                current.first += (next.first - current.first)
+                               * next.second/current.second;
+            } else {
+                cumulated += current.second;
+                centroids_.push_back(current);
+                bound = total*limit(cumulated/total);
+                current = next;
+            }
+        }
+        centroids_.push_back(current);
+
+        weight_ = total;
+        buffer_.clear();
+        bufferWeight_ = 0.0;
+    }
+
+    inline Size QuantileSketch::centroids() const {
+        compress();
+        return centroids_.size();
+    }
+
+    inline Real QuantileSketch::quantile(Real p) const {
+        QL_REQUIRE(p >= 0.0 && p <= 1.0,
+                   "probability (" << p << ") out of range");
+        compress();
+        QL_REQUIRE(!centroids_.empty(), "empty sketch");
+        Size n = centroids_.size();
+        Real target = p*weight_;
+        // centroids are taken to be centered at their mid-weight
+        Real center = centroids_[0].second/2.0;
+        if (target <= center) {
+            if (close(center, 0.0))
+                return min_;
+            return min_ + (centroids_[0].first - min_)*target/center;
+        }
+        for (Size i=1; i<n; ++i) {
+            Real nextCenter = center + (centroids_[i-1].second
+                                        + centroids_[i].second)/2.0;
+            if (target <= nextCenter) {
+                Real x = (target - center)/(nextCenter - center);
+                return centroids_[i-1].first
+                    + x*(centroids_[i].first - centroids_[i-1].first);
+            }
+            center = nextCenter;
+        }
+        Real tail = weight_ - center;
+        if (close(tail, 0.0))
+            return max_;
+        return centroids_[n-1].first
+            + (max_ - centroids_[n-1].first)*(target - center)/tail;
+    }
+
+    inline Real QuantileSketch::tailMean(Real p) const {
+        QL_REQUIRE(p > 0.0 && p < 1.0,
+                   "probability (" << p << ") out of range");
+        compress();
+        QL_REQUIRE(!centroids_.empty(), "empty sketch");
+        bool lower = (p < 0.5);
+        Real mass = (lower ? p : 1.0-p)*weight_;
+        Real sum = 0.0, cumulated = 0.0;
+        Size n = centroids_.size();
+        // whole centroids, then the part of the one crossing the quantile
+        for (Size i=0; i<n && cumulated < mass; ++i) {
+            const centroid& c = centroids_[lower ? i : n-1-i];
+            Real w = std::min(c.second, mass - cumulated);
+            sum += w*c.first;
+            cumulated += w;
+        }
+        return sum/cumulated;
+    }
+
+}
+
+
+#endif
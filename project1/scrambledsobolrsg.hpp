@@ -0,0 +1,200 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file scrambledsobolrsg.hpp
+    \brief Owen-scrambled Sobol sequences for randomized quasi-Monte Carlo
+*/
+
+#ifndef scrambled_sobol_rsg_hpp
+#define scrambled_sobol_rsg_hpp
+
+#include "counterbasedrng.hpp"
+#include <ql/math/randomnumbers/sobolrsg.hpp>
+
+namespace QuantLib {
+
+    //! Owen-scrambled Sobol uniform low-discrepancy sequence generator
+    /*! Each coordinate of the Sobol points goes through a nested
+        uniform (Owen) scrambling, implemented as the hash-based
+        permutation of B. Burley, "Practical Hash-based Owen
+        Scrambling", JCGT 9(4), 2020. Different seeds give independent
+        randomizations of the same point set; each of them keeps the
+        low discrepancy of the original sequence, while its points are
+        uniformly distributed.
+
+        Unlike SobolRsg, which skips it, the sequence starts at the
+        origin, so that its first \f$ 2^m \f$ points form a
+        \f$ (t,m,s) \f$-net before and after scrambling.
+
+        \ingroup mcarlo
+    */
+    class OwenScrambledSobolRsg {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        /*! if the given seed is 0, a random seed is chosen. */
+        explicit OwenScrambledSobolRsg(
+                Size dimensionality,
+                BigNatural seed = 0,
+                BigNatural firstSequence = 0,
+                SobolRsg::DirectionIntegers directionIntegers =
+                                                           SobolRsg::Jaeckel);
+        const sample_type& nextSequence() const;
+        const sample_type& lastSequence() const { return sequence_; }
+        Size dimension() const { return dimensionality_; }
+        //! nested uniform scrambling of a 32-bit binary fraction
+        static boost::uint32_t scramble(boost::uint32_t x,
+                                        boost::uint32_t seed);
+      private:
+        static boost::uint32_t reverseBits(boost::uint32_t x);
+        Size dimensionality_;
+        mutable SobolRsg sobol_;
+        // whether the next point is the origin, which sobol_ skips
+        mutable bool origin_;
+        std::vector<boost::uint32_t> seeds_;
+        mutable sample_type sequence_;
+    };
+
+
+    //! randomized quasi-Monte Carlo policy
+    /*! Sequences are Owen-scrambled Sobol points; each seed gives an
+        independent randomization.
+
+        Although the points of a single randomization are not
+        independent, the policy declares to allow an error estimate:
+        engines supporting it (see RandomizationTraits) run several
+        randomizations and estimate the error from their spread.
+    */
+    template <class IC>
+    struct GenericRandomizedLowDiscrepancy {
+        // typedefs
+        typedef OwenScrambledSobolRsg ursg_type;
+        typedef InverseCumulativeRsg<ursg_type,IC> rsg_type;
+        // more traits
+        enum { allowsErrorEstimate = 1 };
+        // factory
+        static rsg_type make_sequence_generator(Size dimension,
+                                                BigNatural seed,
+                                                BigNatural firstSequence = 0) {
+            ursg_type g(dimension, seed, firstSequence);
+            return (icInstance ? rsg_type(g, *icInstance) : rsg_type(g));
+        }
+        // data
+        static boost::shared_ptr<IC> icInstance;
+    };
+
+    // static member definitions
+
+    template <class IC>
+    boost::shared_ptr<IC> GenericRandomizedLowDiscrepancy<IC>::icInstance;
+
+
+    //! default randomized quasi-Monte Carlo traits
+    typedef GenericRandomizedLowDiscrepancy<InverseCumulativeNormal>
+                                                   RandomizedLowDiscrepancy;
+
+
+    //! randomization capability of random-number policies
+    /*! For policies where isRandomized is true, the samples drawn
+        with a given seed are not independent; the error must be
+        estimated from the spread of the results obtained with
+        several seeds.
+    */
+    template <class RNG>
+    struct RandomizationTraits {
+        enum { isRandomized = 0 };
+    };
+
+    template <class IC>
+    struct RandomizationTraits<GenericRandomizedLowDiscrepancy<IC> > {
+        enum { isRandomized = 1 };
+    };
+
+    template <class IC>
+    struct RandomAccessTraits<GenericRandomizedLowDiscrepancy<IC> > {
+        enum { allowsRandomAccess = 1 };
+        static typename GenericRandomizedLowDiscrepancy<IC>::rsg_type
+        make_sequence_generator(Size dimension, BigNatural seed,
+                                BigNatural firstSequence) {
+            return GenericRandomizedLowDiscrepancy<IC>::
+                make_sequence_generator(dimension, seed, firstSequence);
+        }
+    };
+
+
+    // inline definitions
+
+    inline OwenScrambledSobolRsg::OwenScrambledSobolRsg(
+                                Size dimensionality,
+                                BigNatural seed,
+                                BigNatural firstSequence,
+                                SobolRsg::DirectionIntegers directionIntegers)
+    : dimensionality_(dimensionality),
+      sobol_(dimensionality, 0, directionIntegers),
+      origin_(firstSequence == 0), seeds_(dimensionality),
+      sequence_(std::vector<Real>(dimensionality), 1.0) {
+        if (seed == 0)
+            seed = SeedGenerator::instance().get();
+        boost::uint64_t s = seed;
+        const boost::uint32_t key[2] = { boost::uint32_t(s),
+                                         boost::uint32_t(s >> 32) };
+        // one independent scrambling seed per coordinate
+        for (Size j=0; j<dimensionality_; j+=4) {
+            boost::uint32_t c[4] = { boost::uint32_t(j/4), 1, 0, 0 };
+            PhiloxUniformRsg::philox(c, key);
+            for (Size k=0; k<4 && j+k<dimensionality_; ++k)
+                seeds_[j+k] = c[k];
+        }
+        if (firstSequence != 0) {
+            QL_REQUIRE(firstSequence < BigNatural(QL_MAX_INTEGER),
+                       "first sequence (" << firstSequence
+                       << ") out of range");
+            // the n-th point of sobol_ is the (n+1)-th of the sequence
+            sobol_.skipTo(boost::uint32_t(firstSequence-1));
+        }
+    }
+
+    inline boost::uint32_t OwenScrambledSobolRsg::reverseBits(
+                                                        boost::uint32_t x) {
+        x = ((x >> 1) & 0x55555555UL) | ((x & 0x55555555UL) << 1);
+        x = ((x >> 2) & 0x33333333UL) | ((x & 0x33333333UL) << 2);
+        x = ((x >> 4) & 0x0F0F0F0FUL) | ((x & 0x0F0F0F0FUL) << 4);
+        x = ((x >> 8) & 0x00FF00FFUL) | ((x & 0x00FF00FFUL) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    inline boost::uint32_t OwenScrambledSobolRsg::scramble(
+                                                    boost::uint32_t x,
+                                                    boost::uint32_t seed) {
+        /* In bit-reversed order, the Laine-Karras permutation
+           changes each bit according to the lower ones only; reversed
+           back, each digit is permuted depending on the leading ones,
+           which is Owen's nested scrambling. */
+        x = reverseBits(x);
+        x ^= x * 0x3D20ADEAUL;
+        x += seed;
+        x *= (seed >> 16) | 1;
+        x ^= x * 0x05526C56UL;
+        x ^= x * 0x53A22864UL;
+        return reverseBits(x);
+    }
+
+    inline const OwenScrambledSobolRsg::sample_type&
+    OwenScrambledSobolRsg::nextSequence() const {
+        std::vector<Real>& values = sequence_.value;
+        if (origin_) {
+            origin_ = false;
+            for (Size j=0; j<dimensionality_; ++j)
+                values[j] = (Real(scramble(0, seeds_[j])) + 0.5)
+                          / 4294967296.0;
+            return sequence_;
+        }
+        const std::vector<boost::uint32_t>& v = sobol_.nextInt32Sequence();
+        for (Size j=0; j<dimensionality_; ++j)
+            values[j] = (Real(scramble(v[j], seeds_[j])) + 0.5)
+                      / 4294967296.0;
+        return sequence_;
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,260 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ Copyright (C) 2002, 2003, 2004 Ferdinando Ametrano
+ Copyright (C) 2002, 2003 Sadruddin Rejeb
+ Copyright (C) 2005, 2007 StatPro Italia srl
+
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file extendedbinomialengine.hpp
+    \brief Binomial option engine on time-dependent trees
+*/
+
+#ifndef extended_binomial_engine_hpp
+#define extended_binomial_engine_hpp
+
+#include "extendedbinomialtree.hpp"
+#include <ql/methods/lattices/lattice1d.hpp>
+#include <ql/pricingengines/vanilla/discretizedvanillaoption.hpp>
+#include <ql/pricingengines/greeks.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include <ql/utilities/null.hpp>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Lattice on a time-dependent binomial tree
+    /*! Unlike BlackScholesLattice, which takes the rate and the
+        probabilities of the first step for the whole tree, discount
+        factors are given for each step and probabilities are read
+        from the tree at each step.
+
+        Node values are filled a level at a time into a buffer of the
+        lattice, which holds the last level queried; the lattice is
+        meant to be used by a single calculation, while the tree can
+        be shared.
+
+        \ingroup lattices
+    */
+    template <class T>
+    class ExtendedBlackScholesLattice
+        : public TreeLattice1D<ExtendedBlackScholesLattice<T> > {
+      public:
+        //! discounts[i] discounts from the (i+1)-th time to the i-th
+        ExtendedBlackScholesLattice(const boost::shared_ptr<T>& tree,
+                                    const std::vector<DiscountFactor>&
+                                                                 discounts,
+                                    const TimeGrid& grid)
+        : TreeLattice1D<ExtendedBlackScholesLattice<T> >(grid, 2),
+          tree_(tree), discounts_(discounts), level_(Null<Size>()),
+          levelValues_(grid.size()) {
+            QL_REQUIRE(discounts.size() == grid.size()-1,
+                       discounts.size() << " discount factors given for "
+                       << grid.size()-1 << " steps");
+        }
+
+        Size size(Size i) const { return tree_->size(i); }
+        DiscountFactor discount(Size i) const { return discounts_[i]; }
+        void stepback(Size i, const Array& values, Array& newValues) const {
+            // probabilities depend on the step only
+            Real pd = tree_->probability(i, 0, 0)*discounts_[i];
+            Real pu = tree_->probability(i, 0, 1)*discounts_[i];
+            for (Size j=0; j<size(i); j++)
+                newValues[j] = pd*values[j] + pu*values[j+1];
+        }
+        Real underlying(Size i, Size index) const {
+            if (i != level_) {
+                tree_->fillLevel(i, &levelValues_[0]);
+                level_ = i;
+            }
+            return levelValues_[index];
+        }
+        Size descendant(Size i, Size index, Size branch) const {
+            return tree_->descendant(i, index, branch);
+        }
+        Real probability(Size i, Size index, Size branch) const {
+            return tree_->probability(i, index, branch);
+        }
+      protected:
+        boost::shared_ptr<T> tree_;
+        std::vector<DiscountFactor> discounts_;
+      private:
+        mutable Size level_;
+        mutable std::vector<Real> levelValues_;
+    };
+
+
+    //! Pricing engine for vanilla options using time-dependent trees
+    /*! The tree is built on the given process itself, rather than on
+        a constant-coefficient process flattened at maturity, so that
+        term structures of rates and volatility are followed along the
+        tree. Steps are taken on a time grid over which the Black
+        variance at the strike grows by the same amount at each step,
+        so that equal-jumps trees keep the same jump throughout and
+        their nodes match the integrated variance at each time; the
+        drift of each step is matched by its probabilities and its
+        discount factor. The trees sample the process once per step;
+        the engine samples the risk-free curve onto the tree grid in
+        a single pass to obtain the discount factor of each step.
+
+        \ingroup vanillaengines
+    */
+    template <class T>
+    class ExtendedBinomialVanillaEngine : public VanillaOption::engine {
+      public:
+        ExtendedBinomialVanillaEngine(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps)
+        : process_(process), timeSteps_(timeSteps) {
+            QL_REQUIRE(timeSteps >= 2,
+                       "at least 2 time steps required, "
+                       << timeSteps << " provided");
+            registerWith(process_);
+        }
+        void calculate() const;
+      private:
+        TimeGrid equalVarianceGrid(Time maturity, Size steps,
+                                   Real strike) const;
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size timeSteps_;
+    };
+
+
+    // template definitions
+
+    template <class T>
+    TimeGrid ExtendedBinomialVanillaEngine<T>::equalVarianceGrid(
+                                Time maturity, Size steps, Real strike) const {
+        const Handle<BlackVolTermStructure>& vol =
+            process_->blackVolatility();
+        Real totalVariance = vol->blackVariance(maturity, strike);
+        QL_REQUIRE(totalVariance > 0.0,
+                   "positive variance required at maturity");
+
+        // the Black variance is non-decreasing in time, so that the
+        // time at which it reaches a given fraction of the total is
+        // found by bisection; the search starts from the previous time
+        std::vector<Time> times(steps+1);
+        times[0] = 0.0;
+        times[steps] = maturity;
+        for (Size i=1; i<steps; ++i) {
+            Real target = totalVariance*i/steps;
+            Time low = times[i-1], high = maturity;
+            for (Size k=0; k<60 && high-low > QL_EPSILON*maturity; ++k) {
+                Time t = 0.5*(low+high);
+                if (vol->blackVariance(t, strike) < target)
+                    low = t;
+                else
+                    high = t;
+            }
+            times[i] = high;
+        }
+        TimeGrid grid(times.begin(), times.end());
+        QL_ENSURE(grid.size() == steps+1,
+                  "equal-variance grid has " << grid.size()-1
+                  << " distinct steps, " << steps << " required");
+        return grid;
+    }
+
+    template <class T>
+    void ExtendedBinomialVanillaEngine<T>::calculate() const {
+
+        Real s0 = process_->stateVariable()->value();
+        QL_REQUIRE(s0 > 0.0, "negative or null underlying given");
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        Date maturityDate = arguments_.exercise->lastDate();
+        Time maturity = process_->time(maturityDate);
+
+        // some trees adjust the number of steps
+        Size steps = T::adjustedSteps(timeSteps_);
+        TimeGrid grid = equalVarianceGrid(maturity, steps,
+                                          payoff->strike());
+
+        boost::shared_ptr<T> tree(new T(process_, grid, payoff->strike()));
+
+        // the risk-free curve, sampled once on the tree grid
+        std::vector<DiscountFactor> discounts(steps);
+        DiscountFactor previous = process_->riskFreeRate()->discount(grid[0]);
+        for (Size i=0; i<steps; ++i) {
+            DiscountFactor next =
+                process_->riskFreeRate()->discount(grid[i+1]);
+            discounts[i] = next/previous;
+            previous = next;
+        }
+
+        boost::shared_ptr<ExtendedBlackScholesLattice<T> > lattice(
+            new ExtendedBlackScholesLattice<T>(tree, discounts, grid));
+
+        DiscretizedVanillaOption option(arguments_, *process_, grid);
+
+        option.initialize(lattice, maturity);
+
+        // Partial derivatives calculated from various points in the
+        // binomial tree
+        // (see J.C.Hull, "Options, Futures and other derivatives",
+        // 6th edition, pp 397/398)
+
+        // Rollback to third-last step, and get underlying prices (s2) &
+        // option values (p2) at this point
+        option.rollback(grid[2]);
+        Array va2(option.values());
+        QL_ENSURE(va2.size() == 3, "Expect 3 nodes in grid at second step");
+        Real p2u = va2[2]; // up
+        Real p2m = va2[1]; // mid
+        Real p2d = va2[0]; // down (low)
+        Real s2u = lattice->underlying(2, 2); // up price
+        Real s2m = lattice->underlying(2, 1); // middle price
+        Real s2d = lattice->underlying(2, 0); // down (low) price
+
+        // calculate gamma by taking the first derivate of the two deltas
+        Real delta2u = (p2u - p2m)/(s2u-s2m);
+        Real delta2d = (p2m-p2d)/(s2m-s2d);
+        Real gamma = (delta2u - delta2d) / ((s2u-s2d)/2);
+
+        // Rollback to second-last step, and get option values (p1) at
+        // this point
+        option.rollback(grid[1]);
+        Array va(option.values());
+        QL_ENSURE(va.size() == 2, "Expect 2 nodes in grid at first step");
+        Real p1u = va[1];
+        Real p1d = va[0];
+        Real s1u = lattice->underlying(1, 1); // up (high) price
+        Real s1d = lattice->underlying(1, 0); // down (low) price
+
+        Real delta = (p1u - p1d) / (s1u - s1d);
+
+        // Finally, rollback to t=0
+        option.rollback(0.0);
+        Real p0 = option.presentValue();
+
+        // Store results
+        results_.value = p0;
+        results_.delta = delta;
+        results_.gamma = gamma;
+        results_.theta = blackScholesTheta(process_,
+                                           results_.value,
+                                           results_.delta,
+                                           results_.gamma);
+    }
+
+}
+
+
+#endif
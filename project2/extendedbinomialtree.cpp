@@ -30,12 +30,15 @@ namespace QuantLib {
                         Time end, Size steps, Real)
     : ExtendedEqualProbabilitiesBinomialTree_2<ExtendedJarrowRudd_2>(
                                                         process, end, steps) {
-        // drift removed
-        up_ = process->stdDeviation(0.0, x0_, dt_);
+        initializeSteps();
     }
 
-    Real ExtendedJarrowRudd_2::upStep(Time stepTime) const {
-        return treeProcess_->stdDeviation(stepTime, x0_, dt_);
+    ExtendedJarrowRudd_2::ExtendedJarrowRudd_2(
+                        const boost::shared_ptr<StochasticProcess1D>& process,
+                        const TimeGrid& grid, Real)
+    : ExtendedEqualProbabilitiesBinomialTree_2<ExtendedJarrowRudd_2>(
+                                                        process, grid) {
+        initializeSteps();
     }
 
 
@@ -45,21 +48,15 @@ namespace QuantLib {
                         Time end, Size steps, Real)
     : ExtendedEqualJumpsBinomialTree_2<ExtendedCoxRossRubinstein_2>(
                                                         process, end, steps) {
-
-        dx_ = process->stdDeviation(0.0, x0_, dt_);
-        pu_ = 0.5 + 0.5*this->driftStep(0.0)/dx_;
-        pd_ = 1.0 - pu_;
-
-        QL_REQUIRE(pu_<=1.0, "negative probability");
-        QL_REQUIRE(pu_>=0.0, "negative probability");
-    }
-
-    Real ExtendedCoxRossRubinstein_2::dxStep(Time stepTime) const {
-        return this->treeProcess_->stdDeviation(stepTime, x0_, dt_);
+        initializeSteps();
     }
 
-    Real ExtendedCoxRossRubinstein_2::probUp(Time stepTime) const {
-        return 0.5 + 0.5*this->driftStep(stepTime)/dxStep(stepTime);
+    ExtendedCoxRossRubinstein_2::ExtendedCoxRossRubinstein_2(
+                        const boost::shared_ptr<StochasticProcess1D>& process,
+                        const TimeGrid& grid, Real)
+    : ExtendedEqualJumpsBinomialTree_2<ExtendedCoxRossRubinstein_2>(
+                                                        process, grid) {
+        initializeSteps();
     }
 
 
@@ -68,16 +65,15 @@ namespace QuantLib {
                         Time end, Size steps, Real)
     : ExtendedEqualProbabilitiesBinomialTree_2<ExtendedAdditiveEQPBinomialTree_2>(
                                                         process, end, steps) {
-
-          up_ = - 0.5 * this->driftStep(0.0) + 0.5 *
-            std::sqrt(4.0*process->variance(0.0, x0_, dt_)-
-                      3.0*this->driftStep(0.0)*this->driftStep(0.0));
+        initializeSteps();
     }
 
-    Real ExtendedAdditiveEQPBinomialTree_2::upStep(Time stepTime) const {
-        return (- 0.5 * this->driftStep(stepTime) + 0.5 *
-            std::sqrt(4.0*this->treeProcess_->variance(stepTime, x0_, dt_)-
-            3.0*this->driftStep(stepTime)*this->driftStep(stepTime)));
+    ExtendedAdditiveEQPBinomialTree_2::ExtendedAdditiveEQPBinomialTree_2(
+                        const boost::shared_ptr<StochasticProcess1D>& process,
+                        const TimeGrid& grid, Real)
+    : ExtendedEqualProbabilitiesBinomialTree_2<ExtendedAdditiveEQPBinomialTree_2>(
+                                                        process, grid) {
+        initializeSteps();
     }
 
 
@@ -87,23 +83,14 @@ namespace QuantLib {
                         const boost::shared_ptr<StochasticProcess1D>& process,
                         Time end, Size steps, Real)
     : ExtendedEqualJumpsBinomialTree_2<ExtendedTrigeorgis_2>(process, end, steps) {
-
-        dx_ = std::sqrt(process->variance(0.0, x0_, dt_)+
-            this->driftStep(0.0)*this->driftStep(0.0));
-        pu_ = 0.5 + 0.5*this->driftStep(0.0)/this->dxStep(0.0);
-        pd_ = 1.0 - pu_;
-
-        QL_REQUIRE(pu_<=1.0, "negative probability");
-        QL_REQUIRE(pu_>=0.0, "negative probability");
-    }
-
-    Real ExtendedTrigeorgis_2::dxStep(Time stepTime) const {
-        return std::sqrt(this->treeProcess_->variance(stepTime, x0_, dt_)+
-            this->driftStep(stepTime)*this->driftStep(stepTime));
+        initializeSteps();
     }
 
-    Real ExtendedTrigeorgis_2::probUp(Time stepTime) const {
-        return 0.5 + 0.5*this->driftStep(stepTime)/dxStep(stepTime);
+    ExtendedTrigeorgis_2::ExtendedTrigeorgis_2(
+                        const boost::shared_ptr<StochasticProcess1D>& process,
+                        const TimeGrid& grid, Real)
+    : ExtendedEqualJumpsBinomialTree_2<ExtendedTrigeorgis_2>(process, grid) {
+        initializeSteps();
     }
 
 
@@ -111,46 +98,44 @@ namespace QuantLib {
                         const boost::shared_ptr<StochasticProcess1D>& process,
                         Time end, Size steps, Real)
     : ExtendedBinomialTree_2<ExtendedTian_2>(process, end, steps) {
+        initializeSteps();
+    }
 
-        Real q = std::exp(process->variance(0.0, x0_, dt_));
-
-        Real r = std::exp(this->driftStep(0.0))*std::sqrt(q);
-
-        up_ = 0.5 * r * q * (q + 1 + std::sqrt(q * q + 2 * q - 3));
-        down_ = 0.5 * r * q * (q + 1 - std::sqrt(q * q + 2 * q - 3));
+    ExtendedTian_2::ExtendedTian_2(
+                        const boost::shared_ptr<StochasticProcess1D>& process,
+                        const TimeGrid& grid, Real)
+    : ExtendedBinomialTree_2<ExtendedTian_2>(process, grid) {
+        initializeSteps();
+    }
 
-        pu_ = (r - down_) / (up_ - down_);
-        pd_ = 1.0 - pu_;
+    void ExtendedTian_2::initializeSteps() {
+        Size n = steps();
+        ups_.resize(n);
+        downs_.resize(n);
+        upProbs_.resize(n);
+        for (Size i=0; i<n; ++i) {
+            Real qi = std::exp(treeProcess_->variance(stepTime(i), x0_,
+                                                      stepLength(i)));
+            Real ri = std::exp(drifts_[i])*std::sqrt(qi);
+            Real root = std::sqrt(qi * qi + 2 * qi - 3);
+
+            ups_[i] = 0.5 * ri * qi * (qi + 1 + root);
+            downs_[i] = 0.5 * ri * qi * (qi + 1 - root);
+            upProbs_[i] = (ri - downs_[i]) / (ups_[i] - downs_[i]);
+
+            QL_REQUIRE(upProbs_[i]<=1.0, "negative probability");
+            QL_REQUIRE(upProbs_[i]>=0.0, "negative probability");
+        }
 
         // doesn't work
         //     treeCentering_ = (up_+down_)/2.0;
         //     up_ = up_-treeCentering_;
 
-        QL_REQUIRE(pu_<=1.0, "negative probability");
-        QL_REQUIRE(pu_>=0.0, "negative probability");
-    }
-
-    Real ExtendedTian_2::underlying(Size i, Size index) const {
-        Time stepTime = i*this->dt_;
-        Real q = std::exp(this->treeProcess_->variance(stepTime, x0_, dt_));
-        Real r = std::exp(this->driftStep(stepTime))*std::sqrt(q);
-
-        Real up = 0.5 * r * q * (q + 1 + std::sqrt(q * q + 2 * q - 3));
-        Real down = 0.5 * r * q * (q + 1 - std::sqrt(q * q + 2 * q - 3));
-
-        return x0_ * std::pow(down, Real(BigInteger(i)-BigInteger(index)))
-            * std::pow(up, Real(index));
+        initializeLevels();
     }
 
     Real ExtendedTian_2::probability(Size i, Size, Size branch) const {
-        Time stepTime = i*this->dt_;
-        Real q = std::exp(this->treeProcess_->variance(stepTime, x0_, dt_));
-        Real r = std::exp(this->driftStep(stepTime))*std::sqrt(q);
-
-        Real up = 0.5 * r * q * (q + 1 + std::sqrt(q * q + 2 * q - 3));
-        Real down = 0.5 * r * q * (q + 1 - std::sqrt(q * q + 2 * q - 3));
-
-        Real pu = (r - down) / (up - down);
+        Real pu = upProbs_[i];
         Real pd = 1.0 - pu;
 
         return (branch == 1 ? pu : pd);
@@ -161,49 +146,51 @@ namespace QuantLib {
                         const boost::shared_ptr<StochasticProcess1D>& process,
                         Time end, Size steps, Real strike)
     : ExtendedBinomialTree_2<ExtendedLeisenReimer_2>(process, end,
-                                                     (steps%2 ? steps : steps+1)),
-      end_(end), oddSteps_(steps%2 ? steps : steps+1), strike_(strike) {
-
-        QL_REQUIRE(strike>0.0, "strike " << strike << "must be positive");
-        Real variance = process->variance(0.0, x0_, end);
-
-        Real ermqdt = std::exp(this->driftStep(0.0) + 0.5*variance/oddSteps_);
-        Real d2 = (std::log(x0_/strike) + this->driftStep(0.0)*oddSteps_ ) /
-            std::sqrt(variance);
-
-        pu_ = PeizerPrattMethod2Inversion(d2, oddSteps_);
-        pd_ = 1.0 - pu_;
-        Real pdash = PeizerPrattMethod2Inversion(d2+std::sqrt(variance),
-                                                 oddSteps_);
-        up_ = ermqdt * pdash / pu_;
-        down_ = (ermqdt - pu_ * up_) / (1.0 - pu_);
+                                                     adjustedSteps(steps)),
+      strike_(strike) {
+        initializeSteps();
+    }
 
+    ExtendedLeisenReimer_2::ExtendedLeisenReimer_2(
+                        const boost::shared_ptr<StochasticProcess1D>& process,
+                        const TimeGrid& grid, Real strike)
+    : ExtendedBinomialTree_2<ExtendedLeisenReimer_2>(process, grid),
+      strike_(strike) {
+        QL_REQUIRE(steps()%2 == 1,
+                   "odd number of steps required, " << steps() << " given");
+        initializeSteps();
     }
 
-    Real ExtendedLeisenReimer_2::underlying(Size i, Size index) const {
-        Time stepTime = i*this->dt_;
-        Real variance = this->treeProcess_->variance(stepTime, x0_, end_);
-        Real ermqdt = std::exp(this->driftStep(stepTime) + 0.5*variance/oddSteps_);
-        Real d2 = (std::log(x0_/strike_) + this->driftStep(stepTime)*oddSteps_ ) /
-            std::sqrt(variance);
-
-        Real pu = PeizerPrattMethod2Inversion(d2, oddSteps_);
-        Real pdash = PeizerPrattMethod2Inversion(d2+std::sqrt(variance),
-            oddSteps_);
-        Real up = ermqdt * pdash / pu;
-        Real down = (ermqdt - pu * up) / (1.0 - pu);
-
-        return x0_ * std::pow(down, Real(BigInteger(i)-BigInteger(index)))
-            * std::pow(up, Real(index));
+    void ExtendedLeisenReimer_2::initializeSteps() {
+
+        QL_REQUIRE(strike_>0.0, "strike " << strike_ << "must be positive");
+
+        // as in the original tree, the probability of an up move is
+        // inverted from the d2 of the strike at maturity, and it is
+        // the same for all steps
+        Size n = steps();
+        std::vector<Real> variances(n);
+        Real d2 = terminalD2(strike_, variances);
+        Real pu = PeizerPrattMethod2Inversion(d2, n);
+        ups_.resize(n);
+        downs_.resize(n);
+        upProbs_.assign(n, pu);
+        for (Size i=0; i<n; ++i) {
+            // the probability of the share measure is inverted with
+            // the standard deviation of n steps like this one, so that
+            // the step matches its own variance
+            Real stdDev = std::sqrt(variances[i]*n);
+            Real ermqdt = std::exp(drifts_[i] + 0.5*variances[i]);
+            Real pdash = PeizerPrattMethod2Inversion(d2+stdDev, n);
+            ups_[i] = ermqdt * pdash / pu;
+            downs_[i] = (ermqdt - pu * ups_[i]) / (1.0 - pu);
+        }
+
+        initializeLevels();
     }
 
     Real ExtendedLeisenReimer_2::probability(Size i, Size, Size branch) const {
-        Time stepTime = i*this->dt_;
-        Real variance = this->treeProcess_->variance(stepTime, x0_, end_);
-        Real d2 = (std::log(x0_/strike_) + this->driftStep(stepTime)*oddSteps_ ) /
-            std::sqrt(variance);
-
-        Real pu = PeizerPrattMethod2Inversion(d2, oddSteps_);
+        Real pu = upProbs_[i];
         Real pd = 1.0 - pu;
 
         return (branch == 1 ? pu : pd);
@@ -236,46 +223,46 @@ namespace QuantLib {
                         const boost::shared_ptr<StochasticProcess1D>& process,
                         Time end, Size steps, Real strike)
     : ExtendedBinomialTree_2<ExtendedJoshi4_2>(process, end,
-                                               (steps%2 ? steps : steps+1)),
-      end_(end), oddSteps_(steps%2 ? steps : steps+1), strike_(strike) {
-
-        QL_REQUIRE(strike>0.0, "strike " << strike << "must be positive");
-        Real variance = process->variance(0.0, x0_, end);
-
-        Real ermqdt = std::exp(this->driftStep(0.0) + 0.5*variance/oddSteps_);
-        Real d2 = (std::log(x0_/strike) + this->driftStep(0.0)*oddSteps_ ) /
-            std::sqrt(variance);
-
-        pu_ = computeUpProb((oddSteps_-1.0)/2.0,d2 );
-        pd_ = 1.0 - pu_;
-        Real pdash = computeUpProb((oddSteps_-1.0)/2.0,d2+std::sqrt(variance));
-        up_ = ermqdt * pdash / pu_;
-        down_ = (ermqdt - pu_ * up_) / (1.0 - pu_);
+                                               adjustedSteps(steps)),
+      strike_(strike) {
+        initializeSteps();
     }
 
-    Real ExtendedJoshi4_2::underlying(Size i, Size index) const {
-        Time stepTime = i*this->dt_;
-        Real variance = this->treeProcess_->variance(stepTime, x0_, end_);
-        Real ermqdt = std::exp(this->driftStep(stepTime) + 0.5*variance/oddSteps_);
-        Real d2 = (std::log(x0_/strike_) + this->driftStep(stepTime)*oddSteps_ ) /
-            std::sqrt(variance);
-
-        Real pu = computeUpProb((oddSteps_-1.0)/2.0,d2 );
-        Real pdash = computeUpProb((oddSteps_-1.0)/2.0,d2+std::sqrt(variance));
-        Real up = ermqdt * pdash / pu;
-        Real down = (ermqdt - pu * up) / (1.0 - pu);
+    ExtendedJoshi4_2::ExtendedJoshi4_2(
+                        const boost::shared_ptr<StochasticProcess1D>& process,
+                        const TimeGrid& grid, Real strike)
+    : ExtendedBinomialTree_2<ExtendedJoshi4_2>(process, grid), strike_(strike) {
+        QL_REQUIRE(steps()%2 == 1,
+                   "odd number of steps required, " << steps() << " given");
+        initializeSteps();
+    }
 
-        return x0_ * std::pow(down, Real(BigInteger(i)-BigInteger(index)))
-            * std::pow(up, Real(index));
+    void ExtendedJoshi4_2::initializeSteps() {
+
+        QL_REQUIRE(strike_>0.0, "strike " << strike_ << "must be positive");
+
+        Size n = steps();
+        Real k = (n-1.0)/2.0;
+        std::vector<Real> variances(n);
+        Real d2 = terminalD2(strike_, variances);
+        Real pu = computeUpProb(k, d2);
+        ups_.resize(n);
+        downs_.resize(n);
+        upProbs_.assign(n, pu);
+        for (Size i=0; i<n; ++i) {
+            // see ExtendedLeisenReimer_2
+            Real stdDev = std::sqrt(variances[i]*n);
+            Real ermqdt = std::exp(drifts_[i] + 0.5*variances[i]);
+            Real pdash = computeUpProb(k, d2+stdDev);
+            ups_[i] = ermqdt * pdash / pu;
+            downs_[i] = (ermqdt - pu * ups_[i]) / (1.0 - pu);
+        }
+
+        initializeLevels();
     }
 
     Real ExtendedJoshi4_2::probability(Size i, Size, Size branch) const {
-        Time stepTime = i*this->dt_;
-        Real variance = this->treeProcess_->variance(stepTime, x0_, end_);
-        Real d2 = (std::log(x0_/strike_) + this->driftStep(stepTime)*oddSteps_ ) /
-            std::sqrt(variance);
-
-        Real pu = computeUpProb((oddSteps_-1.0)/2.0,d2 );
+        Real pu = upProbs_[i];
         Real pd = 1.0 - pu;
 
         return (branch == 1 ? pu : pd);
@@ -28,13 +28,36 @@
 #define extended_binomial_tree_hpp
 
 #include <ql/methods/lattices/tree.hpp>
+#include <ql/timegrid.hpp>
 #include <ql/instruments/dividendschedule.hpp>
 #include <ql/stochasticprocess.hpp>
+#include <algorithm>
+#include <vector>
 
 namespace QuantLib {
 
     //! Binomial tree base class
-    /*! \ingroup lattices */
+    /*! The time-dependent parameters of the tree are tabulated once
+        per step, so that node queries don't call the process. Steps
+        are taken on the given time grid, which needs not be regular.
+
+        Derived trees provide logDown(i) and logRatio(i), the
+        logarithms of the down factor of step i and of the ratio
+        between its up and down factors. The lowest node of each level
+        follows from the down moves of all the steps before it, and
+        the nodes of a level are spaced by the ratio of the step
+        leading to it; the tree recombines exactly when the ratio is
+        the same for all steps, e.g., for equal-jumps trees on a grid
+        of steps with equal variance. The tables hold one entry per
+        step, so that the process is never queried past the end of
+        the grid. underlying() computes the value
+        of a single node; lattices visiting the nodes a level at a time
+        can fill the level into a buffer of their own with
+        fillLevel(). The tree itself holds no mutable state, so that
+        it can be queried from several threads.
+
+        \ingroup lattices
+    */
     template <class T>
     class ExtendedBinomialTree_2 : public Tree<T> {
       public:
@@ -44,27 +67,111 @@ namespace QuantLib {
                         Time end,
                         Size steps)
         : Tree<T>(steps+1), treeProcess_(process) {
-            x0_ = process->x0();
-            dt_ = end/steps;
-            driftPerStep_ = process->drift(0.0, x0_) * dt_;
+            initializeGrid(TimeGrid(end, steps));
+        }
+        ExtendedBinomialTree_2(
+                        const boost::shared_ptr<StochasticProcess1D>& process,
+                        const TimeGrid& grid)
+        : Tree<T>(grid.size()), treeProcess_(process) {
+            initializeGrid(grid);
         }
+        //! number of steps used by the tree when given the required ones
+        static Size adjustedSteps(Size steps) { return steps; }
         Size size(Size i) const {
             return i+1;
         }
         Size descendant(Size, Size index, Size branch) const {
             return index + branch;
         }
+        Real underlying(Size i, Size index) const {
+            return exactUnderlying(i, index);
+        }
+        //! value at a node, computed without recurrence
+        Real exactUnderlying(Size i, Size index) const {
+            return x0_*std::exp(logLowest_[i] + index*logRatios_[i]);
+        }
+        //! ratio between the values at consecutive nodes of level i
+        Real levelRatio(Size i) const {
+            return std::exp(logRatios_[i]);
+        }
+        //! writes the values of the size(i) nodes of level i
+        /*! Values are obtained by multiplying by the ratio of the
+            level; the exact value is taken every anchorSpacing nodes,
+            so that rounding errors don't build up along the level.
+        */
+        void fillLevel(Size i, Real* values) const {
+            Real powers[anchorSpacing];
+            powers[0] = 1.0;
+            Real ratio = levelRatio(i);
+            for (Size k=1; k<anchorSpacing; ++k)
+                powers[k] = powers[k-1] * ratio;
+            Size n = size(i);
+            for (Size first=0; first<n; first+=anchorSpacing) {
+                Size m = std::min<Size>(anchorSpacing, n-first);
+                Real anchor = exactUnderlying(i, first);
+                for (Size k=0; k<m; ++k)
+                    values[first+k] = anchor * powers[k];
+            }
+        }
       protected:
-        //time dependent drift per step
-        Real driftStep(Time driftTime) const {
-            return this->treeProcess_->drift(driftTime, x0_) * dt_;
+        enum { anchorSpacing = 64 };
+        //! number of steps, i.e., of entries in the step tables
+        Size steps() const { return this->columns()-1; }
+        //! start of step i
+        Time stepTime(Size i) const { return times_[i]; }
+        //! length of step i
+        Time stepLength(Size i) const { return lengths_[i]; }
+        /*! Black d2 of the given strike at the end of the grid, from
+            the drift and variance of all the steps; the variance of
+            each step is written into the given vector. */
+        Real terminalD2(Real strike, std::vector<Real>& variances) const {
+            Real drift = 0.0, variance = 0.0;
+            for (Size i=0; i<steps(); ++i) {
+                variances[i] = treeProcess_->variance(stepTime(i), x0_,
+                                                      stepLength(i));
+                drift += drifts_[i];
+                variance += variances[i];
+            }
+            return (std::log(x0_/strike) + drift)/std::sqrt(variance);
+        }
+        /*! to be called by the derived constructors once the tables
+            used by T::logDown and T::logRatio are filled */
+        void initializeLevels() {
+            const T& tree = this->impl();
+            Size n = this->columns();
+            logLowest_.resize(n);
+            logRatios_.resize(n);
+            logLowest_[0] = 0.0;
+            // the ratio of the single node of level 0 is never used
+            logRatios_[0] = tree.logRatio(0);
+            for (Size i=1; i<n; ++i) {
+                logLowest_[i] = logLowest_[i-1] + tree.logDown(i-1);
+                logRatios_[i] = tree.logRatio(i-1);
+            }
         }
 
-        Real x0_, driftPerStep_;
-        Time dt_;
-
-      protected:
+        Real x0_;
         boost::shared_ptr<StochasticProcess1D> treeProcess_;
+        std::vector<Time> times_, lengths_;
+        // drift over each step i
+        std::vector<Real> drifts_;
+      private:
+        void initializeGrid(const TimeGrid& grid) {
+            Size n = grid.size();
+            QL_REQUIRE(n > 1, "at least one step required");
+            x0_ = treeProcess_->x0();
+            times_.resize(n-1);
+            lengths_.resize(n-1);
+            drifts_.resize(n-1);
+            for (Size i=0; i<n-1; ++i) {
+                times_[i] = grid[i];
+                lengths_[i] = grid.dt(i);
+                drifts_[i] =
+                    treeProcess_->drift(times_[i], x0_) * lengths_[i];
+            }
+        }
+        // log of the lowest node and of the node ratio of each level
+        std::vector<Real> logLowest_, logRatios_;
     };
 
 
@@ -79,20 +186,30 @@ namespace QuantLib {
                         Time end,
                         Size steps)
         : ExtendedBinomialTree_2<T>(process, end, steps) {}
-        virtual ~ExtendedEqualProbabilitiesBinomialTree_2() {}
+        ExtendedEqualProbabilitiesBinomialTree_2(
+                        const boost::shared_ptr<StochasticProcess1D>& process,
+                        const TimeGrid& grid)
+        : ExtendedBinomialTree_2<T>(process, grid) {}
 
-        Real underlying(Size i, Size index) const {
-            Time stepTime = i*this->dt_;
-            BigInteger j = 2*BigInteger(index) - BigInteger(i);
-            // exploiting the forward value tree centering
-            return this->x0_*std::exp(i*this->driftStep(stepTime) + j*this->upStep(stepTime));
-        }
+        // exploiting the forward value tree centering
+        Real logDown(Size i) const { return this->drifts_[i] - upSteps_[i]; }
+        Real logRatio(Size i) const { return 2.0*upSteps_[i]; }
 
         Real probability(Size, Size, Size) const { return 0.5; }
       protected:
-        //the tree dependent up move term at time stepTime
-        virtual Real upStep(Time stepTime) const = 0;
-        Real up_;
+        // T::upStep(i), the tree dependent up move term of step i, is
+        // dispatched statically and can be inlined; it is not
+        // available while this class is constructed, so that the
+        // derived constructors fill its table
+        void initializeSteps() {
+            const T& tree = this->impl();
+            Size n = this->steps();
+            upSteps_.resize(n);
+            for (Size i=0; i<n; ++i)
+                upSteps_[i] = tree.upStep(i);
+            this->initializeLevels();
+        }
+        std::vector<Real> upSteps_;
     };
 
 
@@ -106,28 +223,41 @@ namespace QuantLib {
                         Time end,
                         Size steps)
         : ExtendedBinomialTree_2<T>(process, end, steps) {}
-        virtual ~ExtendedEqualJumpsBinomialTree_2() {}
+        ExtendedEqualJumpsBinomialTree_2(
+                        const boost::shared_ptr<StochasticProcess1D>& process,
+                        const TimeGrid& grid)
+        : ExtendedBinomialTree_2<T>(process, grid) {}
 
-        Real underlying(Size i, Size index) const {
-            Time stepTime = i*this->dt_;
-            BigInteger j = 2*BigInteger(index) - BigInteger(i);
-            // exploiting equal jump and the x0_ tree centering
-            return this->x0_*std::exp(j*this->dxStep(stepTime));
-        }
+        // exploiting equal jump and the x0_ tree centering
+        Real logDown(Size i) const { return -dxSteps_[i]; }
+        Real logRatio(Size i) const { return 2.0*dxSteps_[i]; }
 
         Real probability(Size i, Size, Size branch) const {
-            Time stepTime = i*this->dt_;
-            Real upProb = this->probUp(stepTime);
+            Real upProb = upProbs_[i];
             Real downProb = 1 - upProb;
             return (branch == 1 ? upProb : downProb);
         }
       protected:
-        //probability of a up move
-        virtual Real probUp(Time stepTime) const = 0;
-        //time dependent term dx_
-        virtual Real dxStep(Time stepTime) const = 0;
+        // T::probUp(i), the probability of a up move, and T::dxStep(i),
+        // the time dependent jump, are dispatched statically and
+        // can be inlined; they are not available while this class is
+        // constructed, so that the derived constructors fill their
+        // tables
+        void initializeSteps() {
+            const T& tree = this->impl();
+            Size n = this->steps();
+            dxSteps_.resize(n);
+            upProbs_.resize(n);
+            for (Size i=0; i<n; ++i) {
+                dxSteps_[i] = tree.dxStep(i);
+                upProbs_[i] = tree.probUp(i);
+                QL_REQUIRE(upProbs_[i]<=1.0, "negative probability");
+                QL_REQUIRE(upProbs_[i]>=0.0, "negative probability");
+            }
+            this->initializeLevels();
+        }
 
-        Real dx_, pu_, pd_;
+        std::vector<Real> dxSteps_, upProbs_;
     };
 
 
@@ -140,8 +270,17 @@ namespace QuantLib {
                              Time end,
                              Size steps,
                              Real strike);
+        ExtendedJarrowRudd_2(const boost::shared_ptr<StochasticProcess1D>&,
+                             const TimeGrid& grid,
+                             Real strike);
       protected:
-        Real upStep(Time stepTime) const;
+        friend class
+            ExtendedEqualProbabilitiesBinomialTree_2<ExtendedJarrowRudd_2>;
+        Real upStep(Size i) const {
+            // drift removed
+            return treeProcess_->stdDeviation(stepTime(i), x0_,
+                                              stepLength(i));
+        }
     };
 
 
@@ -155,9 +294,20 @@ namespace QuantLib {
                                 Time end,
                                 Size steps,
                                 Real strike);
+        ExtendedCoxRossRubinstein_2(
+                                const boost::shared_ptr<StochasticProcess1D>&,
+                                const TimeGrid& grid,
+                                Real strike);
       protected:
-          Real dxStep(Time stepTime) const;
-          Real probUp(Time stepTime) const;
+        friend class
+            ExtendedEqualJumpsBinomialTree_2<ExtendedCoxRossRubinstein_2>;
+        Real dxStep(Size i) const {
+            return this->treeProcess_->stdDeviation(stepTime(i), x0_,
+                                                    stepLength(i));
+        }
+        Real probUp(Size i) const {
+            return 0.5 + 0.5*this->drifts_[i]/dxStep(i);
+        }
     };
 
 
@@ -172,9 +322,21 @@ namespace QuantLib {
                         Time end,
                         Size steps,
                         Real strike);
+        ExtendedAdditiveEQPBinomialTree_2(
+                        const boost::shared_ptr<StochasticProcess1D>&,
+                        const TimeGrid& grid,
+                        Real strike);
 
       protected:
-          Real upStep(Time stepTime) const;
+        friend class ExtendedEqualProbabilitiesBinomialTree_2<
+                                            ExtendedAdditiveEQPBinomialTree_2>;
+        Real upStep(Size i) const {
+            Real drift = this->drifts_[i];
+            return (- 0.5 * drift + 0.5 *
+                std::sqrt(4.0*this->treeProcess_->variance(stepTime(i), x0_,
+                                                           stepLength(i))-
+                3.0*drift*drift));
+        }
     };
 
 
@@ -187,9 +349,20 @@ namespace QuantLib {
                              Time end,
                              Size steps,
                              Real strike);
+        ExtendedTrigeorgis_2(const boost::shared_ptr<StochasticProcess1D>&,
+                             const TimeGrid& grid,
+                             Real strike);
     protected:
-        Real dxStep(Time stepTime) const;
-        Real probUp(Time stepTime) const;
+        friend class ExtendedEqualJumpsBinomialTree_2<ExtendedTrigeorgis_2>;
+        Real dxStep(Size i) const {
+            Real drift = this->drifts_[i];
+            return std::sqrt(this->treeProcess_->variance(stepTime(i), x0_,
+                                                          stepLength(i))+
+                drift*drift);
+        }
+        Real probUp(Size i) const {
+            return 0.5 + 0.5*this->drifts_[i]/dxStep(i);
+        }
     };
 
 
@@ -201,15 +374,26 @@ namespace QuantLib {
                        Time end,
                        Size steps,
                        Real strike);
+        ExtendedTian_2(const boost::shared_ptr<StochasticProcess1D>&,
+                       const TimeGrid& grid,
+                       Real strike);
 
-        Real underlying(Size i, Size index) const;
+        Real logDown(Size i) const { return std::log(downs_[i]); }
+        Real logRatio(Size i) const { return std::log(ups_[i]/downs_[i]); }
         Real probability(Size, Size, Size branch) const;
       protected:
-        Real up_, down_, pu_, pd_;
+        void initializeSteps();
+        // per-step up and down factors and up probabilities
+        std::vector<Real> ups_, downs_, upProbs_;
     };
 
     //! Leisen & Reimer tree: multiplicative approach
-    /*! \ingroup lattices */
+    /*! The probability of an up move is the same for all steps,
+        while the factors of each step match its own forward and
+        variance.
+
+        \ingroup lattices
+    */
     class ExtendedLeisenReimer_2
         : public ExtendedBinomialTree_2<ExtendedLeisenReimer_2> {
       public:
@@ -217,13 +401,22 @@ namespace QuantLib {
                                Time end,
                                Size steps,
                                Real strike);
+        //! the grid must have an odd number of steps
+        ExtendedLeisenReimer_2(const boost::shared_ptr<StochasticProcess1D>&,
+                               const TimeGrid& grid,
+                               Real strike);
+        static Size adjustedSteps(Size steps) {
+            return (steps%2 ? steps : steps+1);
+        }
 
-        Real underlying(Size i, Size index) const;
+        Real logDown(Size i) const { return std::log(downs_[i]); }
+        Real logRatio(Size i) const { return std::log(ups_[i]/downs_[i]); }
         Real probability(Size, Size, Size branch) const;
       protected:
-        Time end_;
-        Size oddSteps_;
-        Real strike_, up_, down_, pu_, pd_;
+        void initializeSteps();
+        Real strike_;
+        // per-step up and down factors and up probabilities
+        std::vector<Real> ups_, downs_, upProbs_;
     };
 
 
@@ -233,14 +426,23 @@ namespace QuantLib {
                          Time end,
                          Size steps,
                          Real strike);
+        //! the grid must have an odd number of steps
+        ExtendedJoshi4_2(const boost::shared_ptr<StochasticProcess1D>&,
+                         const TimeGrid& grid,
+                         Real strike);
+        static Size adjustedSteps(Size steps) {
+            return (steps%2 ? steps : steps+1);
+        }
 
-        Real underlying(Size i, Size index) const;
+        Real logDown(Size i) const { return std::log(downs_[i]); }
+        Real logRatio(Size i) const { return std::log(ups_[i]/downs_[i]); }
         Real probability(Size, Size, Size branch) const;
       protected:
+        void initializeSteps();
         Real computeUpProb(Real k, Real dj) const;
-        Time end_;
-        Size oddSteps_;
-        Real strike_, up_, down_, pu_, pd_;
+        Real strike_;
+        // per-step up and down factors and up probabilities
+        std::vector<Real> ups_, downs_, upProbs_;
     };
 
 
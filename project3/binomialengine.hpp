@@ -28,16 +28,68 @@
 #define binomial_engine_hpp
 
 #include <ql/methods/lattices/binomialtree.hpp>
-#include <ql/methods/lattices/bsmlattice.hpp>
+#include <ql/methods/lattices/lattice1d.hpp>
 #include <ql/math/distributions/normaldistribution.hpp>
 #include <ql/pricingengines/vanilla/discretizedvanillaoption.hpp>
 #include <ql/pricingengines/greeks.hpp>
 #include <ql/processes/blackscholesprocess.hpp>
 #include <ql/termstructures/yield/flatforward.hpp>
 #include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include <ql/utilities/null.hpp>
+#include <vector>
 
 namespace QuantLib {
 
+    //! Simple binomial lattice approximating the Black-Scholes model
+    /*! As BlackScholesLattice, except that node values are filled a
+        level at a time into a buffer of the lattice, which holds the
+        last level queried; the lattice is meant to be used by a
+        single calculation, while the tree can be shared.
+
+        \ingroup lattices
+    */
+    template <class T>
+    class BlackScholesLattice_2
+        : public TreeLattice1D<BlackScholesLattice_2<T> > {
+      public:
+        BlackScholesLattice_2(const boost::shared_ptr<T>& tree,
+                              Rate riskFreeRate,
+                              Time end,
+                              Size steps)
+        : TreeLattice1D<BlackScholesLattice_2<T> >(TimeGrid(end, steps), 2),
+          tree_(tree), discount_(std::exp(-riskFreeRate*(end/steps))),
+          pd_(tree->probability(0, 0, 0)), pu_(tree->probability(0, 0, 1)),
+          level_(Null<Size>()), levelValues_(tree->size(steps)) {}
+
+        Size size(Size i) const { return tree_->size(i); }
+        DiscountFactor discount(Size) const { return discount_; }
+        void stepback(Size i, const Array& values, Array& newValues) const {
+            for (Size j=0; j<size(i); j++)
+                newValues[j] = (pd_*values[j] + pu_*values[j+1])*discount_;
+        }
+        Real underlying(Size i, Size index) const {
+            if (i != level_) {
+                tree_->fillLevel(i, &levelValues_[0]);
+                level_ = i;
+            }
+            return levelValues_[index];
+        }
+        Size descendant(Size i, Size index, Size branch) const {
+            return tree_->descendant(i, index, branch);
+        }
+        Real probability(Size i, Size index, Size branch) const {
+            return tree_->probability(i, index, branch);
+        }
+      protected:
+        boost::shared_ptr<T> tree_;
+        DiscountFactor discount_;
+        Real pd_, pu_;
+      private:
+        mutable Size level_;
+        mutable std::vector<Real> levelValues_;
+    };
+
+
     //! Pricing engine for vanilla options using binomial trees
     /*! \ingroup vanillaengines
 
@@ -117,8 +169,8 @@ namespace QuantLib {
         boost::shared_ptr<T> tree(new T(bs, maturity, timeSteps_,
                                         payoff->strike()));
 
-        boost::shared_ptr<BlackScholesLattice<T> > lattice(
-            new BlackScholesLattice<T>(tree, r, maturity, timeSteps_));
+        boost::shared_ptr<BlackScholesLattice_2<T> > lattice(
+            new BlackScholesLattice_2<T>(tree, r, maturity, timeSteps_));
 
         DiscretizedVanillaOption option(arguments_, *process_, grid);
 
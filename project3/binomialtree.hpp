@@ -26,11 +26,20 @@
 #include <ql/methods/lattices/tree.hpp>
 #include <ql/instruments/dividendschedule.hpp>
 #include <ql/stochasticprocess.hpp>
+#include <algorithm>
 
 namespace QuantLib {
 
     //! Binomial tree base class
-    /*! \ingroup lattices */
+    /*! Derived trees provide exactUnderlying(i, index), the value at
+        a node, and levelRatio(i), the ratio between the values at
+        consecutive nodes of level i; underlying() computes the value
+        of a single node, while fillLevel() writes those of a whole
+        level into a buffer of the caller. The tree holds no mutable
+        state, so that it can be queried from several threads.
+
+        \ingroup lattices
+    */
     template <class T>
     class BinomialTree_2 : public Tree<T> {
     public:
@@ -49,7 +58,31 @@ namespace QuantLib {
         Size descendant(Size, Size index, Size branch) const {
             return index + branch;
         }
+        Real underlying(Size i, Size index) const {
+            return this->impl().exactUnderlying(i, index);
+        }
+        //! writes the values of the size(i) nodes of level i
+        /*! Values are obtained by multiplying by the ratio of the
+            level; the exact value is taken every anchorSpacing nodes,
+            so that rounding errors don't build up along the level.
+        */
+        void fillLevel(Size i, Real* values) const {
+            const T& tree = this->impl();
+            Real powers[anchorSpacing];
+            powers[0] = 1.0;
+            Real ratio = tree.levelRatio(i);
+            for (Size k=1; k<anchorSpacing; ++k)
+                powers[k] = powers[k-1] * ratio;
+            Size n = size(i);
+            for (Size first=0; first<n; first+=anchorSpacing) {
+                Size m = std::min<Size>(anchorSpacing, n-first);
+                Real anchor = tree.exactUnderlying(i, first);
+                for (Size k=0; k<m; ++k)
+                    values[first+k] = anchor * powers[k];
+            }
+        }
     protected:
+        enum { anchorSpacing = 64 };
         Real x0_, driftPerStep_;
         Time dt_;
     };
@@ -65,10 +98,13 @@ namespace QuantLib {
             Time end,
             Size steps)
             : BinomialTree_2<T>(process, end, steps) {}
-        Real underlying(Size i, Size index) const {
+        Real exactUnderlying(Size i, Size index) const {
             BigInteger j = 2 * BigInteger(index) - BigInteger(i) - BigInteger(2);
             return this->x0_ * std::exp(i * this->driftPerStep_ + j * this->up_);
         }
+        Real levelRatio(Size) const {
+            return std::exp(2.0 * this->up_);
+        }
         Real probability(Size, Size, Size) const { return 0.5; }
     protected:
         Real up_;
@@ -85,10 +121,13 @@ namespace QuantLib {
             Time end,
             Size steps)
             : BinomialTree_2<T>(process, end, steps) {}
-        Real underlying(Size i, Size index) const {
+        Real exactUnderlying(Size i, Size index) const {
             BigInteger j = 2 * BigInteger(index) - BigInteger(i) - BigInteger(2);
             return this->x0_ * std::exp(j * this->dx_);
         }
+        Real levelRatio(Size) const {
+            return std::exp(2.0 * this->dx_);
+        }
         Real probability(Size, Size, Size branch) const {
             return (branch == 1 ? pu_ : pd_);
         }
@@ -152,7 +191,7 @@ namespace QuantLib {
             Time end,
             Size steps,
             Real strike);
-        Real underlying(Size i, Size index) const {
+        Real exactUnderlying(Size i, Size index) const {
             return x0_ * std::pow(down_, Real(BigInteger(i) - BigInteger(index)) + 1)
                 * std::pow(up_, Real(index) - 1);
             //return x0_ * std::pow(down_, Real(BigInteger(i)-BigInteger(index)))
@@ -161,6 +200,9 @@ namespace QuantLib {
         Real probability(Size, Size, Size branch) const {
             return (branch == 1 ? pu_ : pd_);
         }
+        Real levelRatio(Size) const {
+            return up_ / down_;
+        }
     protected:
         Real up_, down_, pu_, pd_;
     };
@@ -173,7 +215,7 @@ namespace QuantLib {
             Time end,
             Size steps,
             Real strike);
-        Real underlying(Size i, Size index) const {
+        Real exactUnderlying(Size i, Size index) const {
             return x0_ * std::pow(down_, Real(BigInteger(i) - BigInteger(index)) + 1)
                 * std::pow(up_, Real(index) - 1);
             //return x0_ * std::pow(down_, Real(BigInteger(i)-BigInteger(index)))
@@ -182,6 +224,9 @@ namespace QuantLib {
         Real probability(Size, Size, Size branch) const {
             return (branch == 1 ? pu_ : pd_);
         }
+        Real levelRatio(Size) const {
+            return up_ / down_;
+        }
     protected:
         Real up_, down_, pu_, pd_;
     };
@@ -194,7 +239,7 @@ namespace QuantLib {
             Time end,
             Size steps,
             Real strike);
-        Real underlying(Size i, Size index) const {
+        Real exactUnderlying(Size i, Size index) const {
             return x0_ * std::pow(down_, Real(BigInteger(i) - BigInteger(index)) + 1)
                 * std::pow(up_, Real(index) - 1);
             //return x0_ * std::pow(down_, Real(BigInteger(i)-BigInteger(index)))
@@ -203,6 +248,9 @@ namespace QuantLib {
         Real probability(Size, Size, Size branch) const {
             return (branch == 1 ? pu_ : pd_);
         }
+        Real levelRatio(Size) const {
+            return up_ / down_;
+        }
     protected:
         Real computeUpProb(Real k, Real dj) const;
         Real up_, down_, pu_, pd_;